@@ -0,0 +1,120 @@
+#include "Image.hpp"
+#include "ImageIO.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+// Encode time, decode time and output size for each format and encoder profile.
+// Usage: imageio-benchmark [image file] [iterations]
+// Without an image a synthetic photo is used. Every image is also run dithered
+// to the 7 colour palette, which is what the frame server saves most.
+
+static const int DefaultWidth = 640;
+static const int DefaultHeight = 400;
+
+// Smooth gradients with a little noise, close enough to a photo for deflate
+static Image makePhoto(int width, int height)
+{
+  Image img(width, height);
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<int> noise(-6, 6);
+  RGBAColor* pixels = (RGBAColor*)img.data();
+  for (int y = 0; y < height; ++y)
+  {
+    for (int x = 0; x < width; ++x)
+    {
+      float fx = (float)x / width;
+      float fy = (float)y / height;
+      int r = (int)(255 * fx) + noise(rng);
+      int g = (int)(255 * (1.0f - fy)) + noise(rng);
+      int b = (int)(128 + 127 * ((x / 80 + y / 50) % 2 ? fx * fy : 1.0f - fx * fy)) + noise(rng);
+      pixels[y * width + x] = {(uint8_t)std::clamp(r, 0, 255), (uint8_t)std::clamp(g, 0, 255), (uint8_t)std::clamp(b, 0, 255), 255};
+    }
+  }
+  return img;
+}
+
+static Image makeDithered(const Image& photo)
+{
+  IndexedColorMap palette({
+    {ColorName::Black, 0, {57, 48, 57}},
+    {ColorName::White, 1, {204, 194, 184}},
+    {ColorName::Green, 2, {71, 98, 73}},
+    {ColorName::Blue, 3, {81, 71, 107}},
+    {ColorName::Red, 4, {167, 73, 69}},
+    {ColorName::Yellow, 5, {214, 180, 90}},
+    {ColorName::Orange, 6, {200, 121, 91}},
+  });
+  Image dithered;
+  photo.toIndexed(dithered, palette, {.ditherMode = DitherMode::Diffusion, .ditherAccuracy = 0.75f});
+  dithered.toRGBA();
+  return dithered;
+}
+
+template <typename Fn>
+static double averageMilliseconds(int iterations, Fn fn)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i)
+  {
+    fn();
+  }
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+static void benchCodec(const std::string& imageName, const Image& img, const std::string& label, ImageSaveSettings settings, int iterations)
+{
+  try
+  {
+    std::string buffer;
+    double encodeMs = averageMilliseconds(iterations, [&]()
+    {
+      ImageIO::SaveToBuffer(img, buffer, settings);
+    });
+    double decodeMs = averageMilliseconds(iterations, [&]()
+    {
+      ImageIO::LoadFromBuffer(buffer);
+    });
+    fmt::print("{:<10} {:<22} {:>10.2f} {:>10.2f} {:>10}\n", imageName, label, encodeMs, decodeMs, buffer.size());
+  }
+  catch (const std::exception& e)
+  {
+    fmt::print("{:<10} {:<22} failed: {}\n", imageName, label, e.what());
+  }
+}
+
+static void benchImage(const std::string& imageName, const Image& img, int iterations)
+{
+  static const std::pair<EncodeProfile, const char*> profiles[]
+  {
+    {EncodeProfile::Fastest, "Fastest"},
+    {EncodeProfile::Balanced, "Balanced"},
+    {EncodeProfile::Smallest, "Smallest"}
+  };
+
+  for (const auto& [profile, profileName] : profiles)
+  {
+    benchCodec(imageName, img, fmt::format("png {}", profileName), {.saveFormat = ImageFormat::PNG, .encodeProfile = profile}, iterations);
+    benchCodec(imageName, img, fmt::format("png {} mt", profileName), {.saveFormat = ImageFormat::PNG, .encodeProfile = profile, .pngThreads = 0}, iterations);
+    benchCodec(imageName, img, fmt::format("jpeg {}", profileName), {.saveFormat = ImageFormat::JPEG, .encodeProfile = profile}, iterations);
+  }
+  // qoi has no settings, it is here to compare against png for caches
+  benchCodec(imageName, img, "qoi", {.saveFormat = ImageFormat::QOI}, iterations);
+}
+
+int main(int argc, char* argv[])
+{
+  Image photo = (argc > 1) ? ImageIO::LoadFromFile(argv[1]) : makePhoto(DefaultWidth, DefaultHeight);
+  int iterations = (argc > 2) ? std::max(1, std::stoi(argv[2])) : 5;
+  Image dithered = makeDithered(photo);
+
+  fmt::print("{}x{}, average of {} runs\n", photo.width(), photo.height(), iterations);
+  fmt::print("{:<10} {:<22} {:>10} {:>10} {:>10}\n", "image", "encoder", "encode ms", "decode ms", "bytes");
+  benchImage("photo", photo, iterations);
+  benchImage("dithered", dithered, iterations);
+}
@@ -8,4 +8,15 @@ struct BoundingBox
   int height = 0;
 
   void clipTo(const BoundingBox& other);
+
+  // Grow to the smallest box covering both this and other
+  void expandToInclude(const BoundingBox& other);
+
+  bool intersects(const BoundingBox& other) const;
+
+  bool contains(const BoundingBox& other) const;
+
+  bool empty() const;
+
+  int area() const;
 };
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Image.hpp"
+#include "Dither.hpp"
+
+#include <vector>
+#include <unordered_map>
+
+// How a layer's RGBA content is converted to the display palette
+enum class LayerPolicy
+{
+  Diffusion, // Error diffusion, for photos and gradients
+  Ordered,   // Pattern dither, stays stable when the content changes slightly
+  ExactSnap  // Nearest palette color per pixel, for text, QR codes and flat shapes
+};
+
+// Stacks RGBA layers into one indexed frame. Each layer is converted to the palette with
+// its own policy and the result is cached, so a frame only re-converts the layers that
+// changed and then composites the cached indexed layers.
+class Compositor
+{
+public:
+  Compositor(int width, int height, IndexedColorMap colorMap);
+
+  // Add a fully transparent layer on top of the existing ones and return its id.
+  // ditherAccuracy is used by the Diffusion policy.
+  int addLayer(LayerPolicy policy, float ditherAccuracy = 1.0f);
+
+  // Get a layer to draw on. Pixels with alpha of 128 or more cover the layers below.
+  // Draw operations record what they change. Code writing through data() must call addDamage.
+  Image& layer(int id);
+
+  // Replace the content of a layer, the image is scaled to the compositor size if needed
+  void setLayer(int id, const Image& image, ScaleSettings scale = {.scaleMode = ScaleMode::Fill});
+
+  // Make a layer fully transparent again
+  void clearLayer(int id);
+
+  void setVisible(int id, bool visible);
+
+  // Convert changed layers and composite all visible layers bottom to top.
+  // Areas no layer covers are white.
+  const Image& compose();
+
+private:
+  struct Layer
+  {
+    LayerPolicy policy;
+    float ditherAccuracy;
+    bool visible = true;
+    Image canvas;
+    // Indexed pixels and coverage mask (0x00 or 0xFF) of the converted canvas
+    Image converted;
+    std::vector<uint8_t> mask;
+    IncrementalDither dither;
+  };
+
+  Layer& getLayer(int id);
+  void convert(Layer& layer);
+
+  int width_;
+  int height_;
+  IndexedColorMap colorMap_;
+  std::vector<Layer> layers_;
+  std::unordered_map<uint32_t, IndexedColor> snapCache_;
+  Image frame_;
+};
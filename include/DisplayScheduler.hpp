@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Inky.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+// Higher priorities replace pending requests of lower ones, which then wait behind them
+enum class RefreshPriority
+{
+  Background,  // e.g. a slideshow, fine to lose to anything else
+  Normal,      // e.g. an uploaded photo
+  Interactive  // e.g. a button press the user is waiting to see
+};
+
+struct DisplaySchedulerSettings
+{
+  // Minimum time from the glass finishing one refresh to the start of the next, to respect
+  // the panel's duty cycle. Requests that arrive sooner wait and can still be replaced.
+  // Skipped and failed refreshes don't restart it.
+  std::chrono::milliseconds minRefreshInterval = std::chrono::seconds(0);
+};
+
+// Sits in front of an Inky and keeps at most one pending refresh. A new request replaces
+// the pending one unless that has a higher priority, so requests made during a refresh
+// collapse in to the newest one instead of each running its own refresh in turn.
+// The newest request that gave way to a higher priority one is kept as a follow-up, and
+// becomes the pending one once the higher priority refresh starts.
+// Frames are only dithered when their refresh starts, so replaced ones cost nothing.
+// While a scheduler is running, the display should only be refreshed through it.
+class DisplayScheduler
+{
+public:
+  struct Stats
+  {
+    // Requests waiting to run, at most 2 counting the follow-up
+    int queueDepth = 0;
+    bool refreshing = false;
+    uint64_t submitted = 0;
+    // Requests replaced by a newer one, or still waiting when the scheduler was destroyed
+    uint64_t dropped = 0;
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+    // What the last failed refresh threw
+    std::string lastError;
+  };
+
+  DisplayScheduler(Inky& display, DisplaySchedulerSettings settings = {});
+  // Lets a refresh in progress finish, the pending request and follow-up are dropped
+  ~DisplayScheduler();
+
+  // Show image, scaled and dithered the same way Inky::setImage would
+  void submit(const Image& image, RefreshPriority priority = RefreshPriority::Normal,
+              ScaleSettings scale = {.scaleMode = ScaleMode::Fill},
+              DitherSettings dither = {.ditherMode = DitherMode::Diffusion, .ditherAccuracy = 0.75});
+
+  // Run one of the display's built in operations, e.g. a color test
+  void submit(Inky::ShowOperation op, RefreshPriority priority = RefreshPriority::Normal, bool force = false);
+
+  Stats stats() const;
+
+private:
+  struct Request
+  {
+    RefreshPriority priority;
+    Inky::ShowOperation op;
+    bool force;
+    std::optional<Image> image;
+    ScaleSettings scale;
+    DitherSettings dither;
+  };
+
+  void enqueue(Request request);
+  void run();
+
+  Inky& display_;
+  DisplaySchedulerSettings settings_;
+  mutable std::mutex mutex_;
+  std::condition_variable changed_;
+  std::optional<Request> pending_;
+  // Newest request that gave way to a higher priority one, run after pending_
+  std::optional<Request> followUp_;
+  Stats stats_;
+  bool stop_ = false;
+  std::chrono::steady_clock::time_point lastRefreshEnd_;
+  std::thread worker_;
+};
@@ -3,8 +3,57 @@
 #include "Color.hpp"
 #include "Image.hpp"
 
+#include <functional>
+
 // These 
 typedef IndexedColor indexedColorFromRGBA(const RGBAColor&);
 
+// Receives each row of a dither as soon as it is final, top to bottom.
+// row holds the source image width of indexed pixels and is only valid during the call.
+typedef std::function<void(int y, const IndexedColor* row)> DitherRowSink;
+
 void patternDither(const Image& sourceImage, Image& destImage);
-void diffusionDither(const Image& sourceImage, Image& destImage, float ditherAccuracy = 1.0f);
\ No newline at end of file
+void diffusionDither(const Image& sourceImage, Image& destImage, float ditherAccuracy = 1.0f);
+
+// Dither straight in to a sink instead of an indexed image, so the output can go directly
+// in to another format without a full frame in between
+void patternDither(const Image& sourceImage, const IndexedColorMap& colorMap, const DitherRowSink& sink);
+void diffusionDither(const Image& sourceImage, const IndexedColorMap& colorMap, const DitherRowSink& sink, float ditherAccuracy = 1.0f);
+
+// Re-dithers only what changed since the previous frame. Keeps the previous source, result
+// and the diffused input of every row, so an update restarts at the first changed row and
+// stops once the error handed down matches the cached field again.
+// Pixels whose source didn't change always keep their previous color, so unchanged areas don't flicker.
+class IncrementalDither
+{
+public:
+  // Error is considered converged once every channel is within this many Lab units of the cache
+  IncrementalDither(float convergenceEpsilon = 0.5f);
+
+  // Dither source with colorMap. If source has damage tracking enabled only its damaged
+  // regions are compared against the previous frame, otherwise the whole image is.
+  const Image& dither(const Image& source, const IndexedColorMap& colorMap, DitherSettings settings);
+
+  // Forget the cached frame so the next dither is a full one
+  void reset();
+
+  // Number of rows (diffusion) or pixels (pattern) recomputed by the last dither call
+  int lastRowsDithered() const;
+  int lastPixelsDithered() const;
+
+private:
+  void ditherDiffusionRow(int y, int freeStart, int freeEnd, float ditherAccuracy, std::vector<LabColor>& nextRow);
+  bool sameFrameSetup(const Image& source, const IndexedColorMap& colorMap, const DitherSettings& settings) const;
+
+  float convergenceEpsilon_;
+  bool valid_ = false;
+  DitherSettings settings_;
+  Image source_;
+  Image result_;
+  // Lab value of each source pixel
+  std::vector<LabColor> lab_;
+  // Lab value of each pixel plus the error diffused in to it from the row above
+  std::vector<LabColor> rowInput_;
+  int lastRowsDithered_ = 0;
+  int lastPixelsDithered_ = 0;
+};
\ No newline at end of file
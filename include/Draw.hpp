@@ -2,8 +2,11 @@
 
 #include "Image.hpp"
 
+#include <vector>
+
 namespace Draw
 {
+  // Built-in fonts are compiled in to the binary, LoadFont adds more at runtime
   enum class Font : int
   {
     Mono_4x6,
@@ -39,9 +42,48 @@ namespace Draw
     HAlign hAlign = HAlign::Left;
     VAlign vAlign = VAlign::Top;
     RGBAColor color = {0,0,0,255};
+    // Radius of rounded corners in pixels, 0 for square corners
+    int cornerRadius = 0;
+    // Thickness of the outline in pixels, 0 fills the whole box
+    int outline = 0;
+  };
+
+  struct LineStyle
+  {
+    RGBAColor color = {0,0,0,255};
+    // Width of the line in pixels, lines thicker than 1 get round caps
+    int thickness = 1;
+  };
+
+  struct ShapeStyle
+  {
+    RGBAColor color = {0,0,0,255};
+    // Thickness of the outline in pixels, 0 fills the whole shape
+    int outline = 0;
   };
 
+  struct Point
+  {
+    int x = 0;
+    int y = 0;
+  };
+
+  // Load a font image laid out as a 16x16 grid of characters, returns an id to use in TextStyle
+  Font LoadFont(const std::string& path);
+
   void Text(Image& dest, int x, int y, const std::string& str, TextStyle style = {});
 
   void Box(Image& dest, int x, int y, int width, int height, BoxStyle style = {});
+
+  void Line(Image& dest, int x0, int y0, int x1, int y1, LineStyle style = {});
+
+  void Circle(Image& dest, int centerX, int centerY, int radius, ShapeStyle style = {});
+
+  void Ellipse(Image& dest, int centerX, int centerY, int radiusX, int radiusY, ShapeStyle style = {});
+
+  // Points are pixel coordinates, filled shapes use the even-odd rule
+  void Polygon(Image& dest, const std::vector<Point>& points, ShapeStyle style = {});
+
+  // Copy src on to dest with its top left corner at x, y. Both images must have the same pixel format.
+  void Blit(Image& dest, int x, int y, const Image& src);
 }
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+
+// Streaming 64 bit xxHash (XXH64). Fast enough to fingerprint a whole
+// frame before every refresh; not for anything security related.
+class Hash64
+{
+public:
+  Hash64(uint64_t seed = 0);
+
+  void update(const void* data, size_t len);
+  void update(std::span<const uint8_t> data);
+  template <typename T> void updateValue(const T& value) { update(&value, sizeof(T)); }
+
+  // Hash of everything passed to update so far. Can be called more than once.
+  uint64_t digest() const;
+
+private:
+  uint64_t acc_[4];
+  uint64_t seed_;
+  uint64_t totalLen_ = 0;
+  uint8_t buffer_[32];
+  size_t bufferLen_ = 0;
+};
@@ -57,6 +57,10 @@ struct DitherSettings
   // Lower accuracy allows a cleaner result
   // Sane values: (0.5 - 1.0)
   float ditherAccuracy = 1.0f;
+
+  // Used by InkyBase::setImage. Only re-dither what changed since the previous image,
+  // leaving the pixels of unchanged areas exactly as they were.
+  bool incremental = false;
 };
 
 // Operations that flip and rotate the image
@@ -146,10 +150,25 @@ public:
     // Specify a destination image for the operation or leave dest as nullptr to perform the operation in-place.
     void crop(int x, int y, int width, int height, ScaleSettings settings = {});
     void crop(Image& dest, int x, int y, int width, int height, ScaleSettings settings = {}) const;
+
+    // Enable or disable recording of changed regions. Disabling also clears the recorded damage.
+    void setDamageTracking(bool enabled);
+    bool damageTracking() const;
+
+    // Record that a region of the image changed. Does nothing unless damage tracking is enabled.
+    // Draw operations, blits and the whole-image operations above call this automatically,
+    // code that writes through data() directly should call it too.
+    void addDamage(BoundingBox region);
+
+    // Non overlapping regions changed since the last clearDamage, clipped to the image bounds
+    const std::vector<BoundingBox>& damage() const;
+    void clearDamage();
 private:
     friend class ImageIO;
     int width_, height_;
     PixelFormat format_;
     std::vector<uint8_t> data_;
     IndexedColorMap colorMap_;
+    bool trackDamage_ = false;
+    std::vector<BoundingBox> damage_;
 };
@@ -3,39 +3,109 @@
 #include "Image.hpp"
 #include <filesystem>
 #include <iostream>
+#include <span>
 
 enum class ImageFormat
 {
   Auto,
   PNG,
-  JPEG
+  JPEG,
+  QOI   // Lossless and very fast, good for internal caches
+};
+
+// Named encoder presets that trade encode time against output size
+enum class EncodeProfile
+{
+  Fastest,  // zlib level 1, no png filtering, 4:2:0 baseline jpeg
+  Balanced, // zlib default level, adaptive png filtering, 4:4:4 baseline jpeg
+  Smallest  // zlib level 9, exhaustive png filtering, 4:2:0 progressive jpeg
 };
 
 struct ImageLoadSettings
 {
   // Use any orientation metadata to rectify the image as it is loaded
   bool autoRotate = true;
+
+  // The smallest size the caller needs. When set, jpegs are decoded at the
+  // smallest DCT scale that still covers this size (after orientation is applied).
+  int minWidth = 0;
+  int minHeight = 0;
+
+  // Decode the embedded exif thumbnail instead of the full jpeg when it is at least
+  // minWidth x minHeight. Falls back to a scaled decode of the full image.
+  bool allowThumbnail = false;
+};
+
+// Basic properties of an encoded image, read from its headers without decoding any pixels
+struct ImageInfo
+{
+  ImageFormat format = ImageFormat::Auto;
+  int width = 0;
+  int height = 0;
+
+  // Channels stored in the file (palette pngs report 1)
+  int channels = 0;
+
+  // Orientation from the exif metadata, if any
+  FlipRotateOperation orientation = FlipRotateOperation::None;
+
+  // True for progressive jpegs and interlaced pngs
+  bool progressive = false;
 };
 
 struct ImageSaveSettings
 {
   ImageFormat saveFormat = ImageFormat::Auto;
+  EncodeProfile encodeProfile = EncodeProfile::Balanced;
   int jpegQuality = 75;
+
+  // Number of threads used to filter and deflate png data. Values other than 1
+  // split the image into row blocks that are compressed in parallel.
+  // 0 = use all hardware threads
+  int pngThreads = 1;
+};
+
+// A frame already packed into a panel's native wire format, one buffer per display RAM plane.
+// The planes may point into a memory mapped .inky file, which storage keeps alive.
+struct PackedFrame
+{
+  uint8_t displayVariant = 0;
+  int width = 0;
+  int height = 0;
+  IndexedColorMap colorMap;
+  std::vector<std::span<const uint8_t>> planes;
+  std::shared_ptr<const void> storage;
 };
 
 struct ImageIO
 {
 public:
   ImageIO() = delete;
+  static ImageInfo ProbeFromStream(std::istream&);
+  static ImageInfo ProbeFromBuffer(const std::string&);
+  static ImageInfo ProbeFromFile(std::filesystem::path);
   static Image LoadFromStream(std::istream&, ImageLoadSettings settings = {});
   static Image LoadFromBuffer(const std::string&, ImageLoadSettings settings = {});
   static Image LoadFromFile(std::filesystem::path, ImageLoadSettings settings = {});
   static void SaveToStream(const Image&, std::ostream&, ImageSaveSettings settings = {});
   static void SaveToBuffer(const Image&, std::string&, ImageSaveSettings settings = {});
   static void SaveToFile(std::filesystem::path, const Image&, ImageSaveSettings settings = {});
+
+  // Save a packed frame as a .inky file. Plane data is page aligned so the file can be mapped.
+  static void SavePackedFrame(std::filesystem::path, const PackedFrame&);
+  // Memory map a .inky file. The planes point straight into the mapping, nothing is decoded.
+  static PackedFrame MapPackedFrame(std::filesystem::path);
 private: 
+  static void probeJpeg(std::istream&, ImageInfo&, std::vector<uint8_t>* exifSegment = nullptr);
+  static void probePng(std::istream&, ImageInfo&);
   static void readJpeg(std::istream&, Image&, ImageLoadSettings);
   static void writeJpeg(std::ostream&, const Image&, ImageSaveSettings);
   static void readPng(std::istream&, Image&, ImageLoadSettings);
   static void writePng(std::ostream&, const Image&, ImageSaveSettings);
+  static void writePngParallel(std::ostream&, const Image&, ImageSaveSettings);
+  static void probeQoi(std::istream&, ImageInfo&);
+  static void readQoi(std::istream&, Image&, ImageLoadSettings);
+  static void writeQoi(std::ostream&, const Image&, ImageSaveSettings);
+  static void decodeQoi(const uint8_t* data, size_t len, Image&);
+  static void encodeQoi(const Image&, std::string&);
 };
\ No newline at end of file
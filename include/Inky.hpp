@@ -1,7 +1,11 @@
 #pragma once
 
 #include "Image.hpp"
+#include "ImageIO.hpp"
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <future>
 
 class Inky
 {
@@ -46,6 +50,45 @@ public:
       Yellow_wHAT_SSD1683 = 19
   };
 
+  // Waveform used for full refreshes
+  enum class RefreshMode
+  {
+    Standard, // The panel's normal waveform, the cleanest image
+    Fast      // A shorter waveform with a little more ghosting, where the panel has one
+  };
+
+  // The steps of a refresh, in the order a panel goes through them
+  enum class ShowPhase
+  {
+    Packing,   // Getting the frame in the panel's format, or waiting for the display to be free
+    Reset,     // Hard reset of the controller
+    Configure, // Register setup
+    Transfer,  // Sending the frame to display RAM
+    Refresh,   // The panel updating the glass
+    PowerOff   // Powering the panel back down
+  };
+
+  struct PhaseTiming
+  {
+    ShowPhase phase;
+    // Wall time for the whole phase
+    double milliseconds = 0;
+    // Part of that spent waiting for BUSY to release
+    double busyWaitMilliseconds = 0;
+    // Worst delay between BUSY releasing and the waiting thread resuming
+    double busyWakeLatencyMilliseconds = 0;
+  };
+
+  // Progress of a refresh started with showAsync
+  struct ShowProgress
+  {
+    // The phase the refresh is in. Stays at the last phase reached once it is done.
+    std::atomic<ShowPhase> phase {ShowPhase::Packing};
+    // Ready once the refresh finished or was skipped, get() rethrows anything it threw
+    std::shared_future<void> done;
+  };
+  typedef std::shared_ptr<const ShowProgress> ShowHandle;
+
   struct DisplayInfo
   {
     uint16_t width;
@@ -61,6 +104,50 @@ public:
   virtual Image getImage() const = 0;
   virtual const IndexedColorMap& getColorMap() const = 0;
   virtual void setBorder(IndexedColor color) = 0;
-  virtual void show(ShowOperation op = ShowOperation::BufferedImage) = 0;
+  // Waveform for the refreshes started after this, captured with the image like the border.
+  // Panels without a fast waveform, or too cold for it, use the standard one.
+  virtual void setRefreshMode(RefreshMode mode) = 0;
+  // Refresh the panel. If it already shows exactly this frame and border the refresh
+  // is skipped, unless force is set.
+  virtual void show(ShowOperation op = ShowOperation::BufferedImage, bool force = false) = 0;
+
+  // Block until the glass has finished the last refresh. Some panels return from show while
+  // they are still updating, which is fine unless the caller needs to know when it's done.
+  virtual void waitForRefresh() = 0;
+
+  // Like show, but runs on the display's worker thread and returns straight away.
+  // The buffered image and border are captured now, so setImage can carry on during the refresh.
+  virtual ShowHandle showAsync(ShowOperation op = ShowOperation::BufferedImage, bool force = false) = 0;
+
+  // Pack the frame for op into the panel's native format, e.g. to save it with ImageIO::SavePackedFrame
+  virtual PackedFrame packFrame(ShowOperation op = ShowOperation::BufferedImage) = 0;
+
+  // Send a frame packed for this display variant straight to the panel, skipped like show(op)
+  virtual void show(const PackedFrame& frame, bool force = false) = 0;
+
+  // Refresh only the part of the panel inside region with the buffered image, e.g. after drawing
+  // a clock face. Panels that can't update part of the glass, a changed border, or a full refresh
+  // falling due all do a full show instead. Skipped if the region already shows the image.
+  virtual void show(const BoundingBox& region, bool force = false) = 0;
+
+  // Number of partial refreshes allowed before the next one is done as a full refresh to clear
+  // the ghosting they build up. 0 turns partial refreshes off. Defaults to 10.
+  virtual void setFullRefreshInterval(int partialRefreshes) = 0;
+
+  // Step the SPI clock up, checking at each rate that a test pattern written to display RAM reads
+  // back intact, then switch to the fastest good rate less a safety margin and return it. The glass
+  // isn't touched. Throws on panels that can't read back their RAM, use setSpiClock for those.
+  virtual uint32_t calibrateSpiClock() = 0;
+
+  // Use a known good SPI clock. This and calibrateSpiClock save the clock for this unit, and it's
+  // used from then on whenever the display is created.
+  virtual void setSpiClock(uint32_t hz) = 0;
+  virtual uint32_t spiClock() const = 0;
+
+  // Number of refreshes skipped because the panel already showed the frame
+  virtual uint64_t skippedRefreshes() const = 0;
+
+  // Per phase timings of the last refresh that reached the panel
+  virtual std::vector<PhaseTiming> lastShowTimings() const = 0;
   virtual const DisplayInfo& info() const = 0;
 };
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Color.hpp"
+
+#include <cstdint>
+
+// Ways of packing a row of indexed pixels in to 1 bit per pixel. They all give the same bytes.
+enum class PackBitsKernel
+{
+  Scalar, // One pixel at a time, the reference the others are tested against
+  Swar,   // 8 pixels at a time in a 64 bit word, works everywhere
+  Sse2,   // 16 pixels at a time, x86 only
+  Neon    // 16 pixels at a time, arm only
+};
+
+// Pack one row in to 1 bit per pixel, MSB first, padding the last byte with zeros. outA gets
+// a bit set where the pixel is colorA, and outB, unless it is null, where the pixel is colorB.
+// Uses the fastest kernel this build has.
+void packRowBits(const IndexedColor* row, int width, IndexedColor colorA, uint8_t* outA, IndexedColor colorB, uint8_t* outB);
+
+// Same, with a given kernel. Throws if this build doesn't have it.
+void packRowBits(PackBitsKernel kernel, const IndexedColor* row, int width, IndexedColor colorA, uint8_t* outA, IndexedColor colorB, uint8_t* outB);
+
+// True if this build has the kernel
+bool packBitsKernelAvailable(PackBitsKernel kernel);
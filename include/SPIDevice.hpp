@@ -2,6 +2,9 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <span>
+#include <functional>
 
 enum class SPIMode : uint8_t
 {
@@ -24,23 +27,53 @@ inline SPIMode operator|(SPIMode lhs, SPIMode rhs)
   return static_cast<SPIMode>(static_cast<uint8_t>(lhs) | static_cast<uint8_t>(rhs));
 }
 
+// One piece of an SPI transaction, sent with the DC (data/command) line at dataCommand
+struct SPISegment
+{
+  bool dataCommand = false;
+  std::span<const uint8_t> data;
+};
+
 class SPIDevice
 {
 public:
+  // Transfers are split in to blocks of at most maxTransferSizeBytes, and as many blocks as the
+  // spidev buffer (its bufsiz module parameter) holds go to the kernel in a single ioctl
   SPIDevice(std::string spiDeviceName = "/dev/spidev0.0", uint32_t maxBusSpeedHz = 488000, uint32_t maxTransferSizeBytes = 4096, SPIMode mode = SPIMode::SPI_MODE_0);
   virtual ~SPIDevice();
-  // Write the data in buf to the provided address 
-  int write(const std::vector<uint8_t>& buf = std::vector<uint8_t>(), uint16_t delayUs = 0);
+  // Write the data in buf to the provided address. With csChange set chip select is released
+  // between blocks, and stays asserted after the last one until the next transfer.
+  int write(const std::vector<uint8_t>& buf = std::vector<uint8_t>(), uint16_t delayUs = 0, bool csChange = false);
   // Write the data in buf to the provided address
-  int write(const uint8_t* buf, size_t len, uint16_t delayUs = 0);
+  int write(const uint8_t* buf, size_t len, uint16_t delayUs = 0, bool csChange = false);
   // Poke the provided address, wait, then fill buf with the returned data
-  int read(std::vector<uint8_t>& buf, uint16_t delayUs = 0);
+  int read(std::vector<uint8_t>& buf, uint16_t delayUs = 0, bool csChange = false);
   // Poke the provided address, wait, then read len bytes into buf
-  int read(uint8_t* buf, size_t len, uint16_t delayUs = 0);
+  int read(uint8_t* buf, size_t len, uint16_t delayUs = 0, bool csChange = false);
+  // Write segments in order straight from the caller's buffers. Each run of segments with the
+  // same DC level goes out in as few ioctls as the kernel allows, after setDataCommand has been
+  // called to put the DC line at that level. Returns the bytes written, or -1 on failure.
+  int transact(std::span<const SPISegment> segments, const std::function<void(bool)>& setDataCommand, uint16_t delayUs = 0);
+  // Clock rate for the transfers after this
+  void setBusSpeed(uint32_t busSpeedHz);
+  uint32_t busSpeed() const;
 private:
+  // Send tx and/or receive in to rx, batching blocks in to as few ioctls as the kernel allows.
+  // Returns the bytes transferred, or -1 if an ioctl failed.
+  int transfer(const uint8_t* tx, uint8_t* rx, size_t len, uint16_t delayUs, bool csChange);
+  // Add a transfer to the pending message, sending the message each time it fills up
+  int queue(const uint8_t* tx, uint8_t* rx, size_t len, uint16_t delayUs, bool csChange);
+  // Send the pending message, if there is one
+  int flush();
+
   int spiFile_ = -1;
   SPIMode spiMode_ = SPIMode::SPI_MODE_0;
   uint8_t bitsPerWord_ = 8;
   uint32_t maxBusSpeedHz_ = 488000;
   uint32_t maxTransferSizeBytes_ = 4096;
+  // Most bytes spidev accepts in one message, each way
+  size_t maxMessageBytes_ = 4096;
+  // The transfer blocks for one message, reused so transfers don't allocate
+  struct Transfers;
+  std::unique_ptr<Transfers> transfers_;
 };
@@ -24,4 +24,47 @@ void BoundingBox::clipTo(const BoundingBox& other)
   }
   width = std::max(0, width);
   height = std::max(0, height);
+}
+
+void BoundingBox::expandToInclude(const BoundingBox& other)
+{
+  if (other.empty())
+  {
+    return;
+  }
+  if (empty())
+  {
+    *this = other;
+    return;
+  }
+  int right = std::max(x + width, other.x + other.width);
+  int bottom = std::max(y + height, other.y + other.height);
+  x = std::min(x, other.x);
+  y = std::min(y, other.y);
+  width = right - x;
+  height = bottom - y;
+}
+
+bool BoundingBox::intersects(const BoundingBox& other) const
+{
+  return !empty() && !other.empty() &&
+         x < other.x + other.width && other.x < x + width &&
+         y < other.y + other.height && other.y < y + height;
+}
+
+bool BoundingBox::contains(const BoundingBox& other) const
+{
+  return other.x >= x && other.y >= y &&
+         other.x + other.width <= x + width &&
+         other.y + other.height <= y + height;
+}
+
+bool BoundingBox::empty() const
+{
+  return width <= 0 || height <= 0;
+}
+
+int BoundingBox::area() const
+{
+  return empty() ? 0 : width * height;
 }
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "Compositor.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+Compositor::Compositor(int width, int height, IndexedColorMap colorMap) :
+  width_(width),
+  height_(height),
+  colorMap_(colorMap),
+  frame_(width, height, colorMap)
+{
+}
+
+int Compositor::addLayer(LayerPolicy policy, float ditherAccuracy)
+{
+  Layer& layer = layers_.emplace_back(Layer{.policy = policy, .ditherAccuracy = ditherAccuracy});
+  layer.converted = Image(width_, height_, colorMap_);
+  layer.mask.assign(width_ * height_, 0);
+  clearLayer((int)layers_.size() - 1);
+  return (int)layers_.size() - 1;
+}
+
+Compositor::Layer& Compositor::getLayer(int id)
+{
+  if (id < 0 || id >= (int)layers_.size())
+  {
+    throw std::out_of_range(fmt::format("No compositor layer with id {}", id));
+  }
+  return layers_[id];
+}
+
+Image& Compositor::layer(int id)
+{
+  return getLayer(id).canvas;
+}
+
+void Compositor::setLayer(int id, const Image& image, ScaleSettings scale)
+{
+  Layer& layer = getLayer(id);
+  layer.canvas = image;
+  layer.canvas.toRGBA();
+  layer.canvas.scale(width_, height_, scale);
+  layer.canvas.setDamageTracking(true);
+  layer.canvas.addDamage(layer.canvas.bounds());
+}
+
+void Compositor::clearLayer(int id)
+{
+  Layer& layer = getLayer(id);
+  layer.canvas = Image(width_, height_);
+  std::fill_n((RGBAColor*)layer.canvas.data(), width_ * height_, RGBAColor{0, 0, 0, 0});
+  layer.canvas.setDamageTracking(true);
+  layer.canvas.addDamage(layer.canvas.bounds());
+}
+
+void Compositor::setVisible(int id, bool visible)
+{
+  getLayer(id).visible = visible;
+}
+
+void Compositor::convert(Layer& layer)
+{
+  const std::vector<BoundingBox>& damage = layer.canvas.damage();
+  const RGBAColor* src = (const RGBAColor*)layer.canvas.data();
+
+  if (layer.policy == LayerPolicy::ExactSnap)
+  {
+    // Snap each damaged pixel to its nearest palette color. Layers like this use few colors,
+    // so the Lab lookups are cached by RGBA value.
+    IndexedColor* dst = layer.converted.data();
+    for (const auto& region : damage)
+    {
+      for (int y = region.y; y < region.y + region.height; ++y)
+      {
+        for (int x = region.x; x < region.x + region.width; ++x)
+        {
+          const RGBAColor& color = src[x + y * width_];
+          uint32_t key = (uint32_t)color.R | ((uint32_t)color.G << 8) | ((uint32_t)color.B << 16);
+          auto it = snapCache_.find(key);
+          if (it == snapCache_.end())
+          {
+            it = snapCache_.emplace(key, colorMap_.toIndexedColor(color)).first;
+          }
+          dst[x + y * width_] = it->second;
+        }
+      }
+    }
+  }
+  else
+  {
+    // The incremental dither only redoes what changed inside the damaged regions
+    DitherSettings settings
+    {
+      .ditherMode = layer.policy == LayerPolicy::Ordered ? DitherMode::Pattern : DitherMode::Diffusion,
+      .ditherAccuracy = layer.ditherAccuracy
+    };
+    const Image& dithered = layer.dither.dither(layer.canvas, colorMap_, settings);
+    for (const auto& region : damage)
+    {
+      for (int y = region.y; y < region.y + region.height; ++y)
+      {
+        std::memcpy(layer.converted.data() + region.x + y * width_, dithered.data() + region.x + y * width_, region.width);
+      }
+    }
+  }
+
+  // Refresh the coverage mask from alpha
+  for (const auto& region : damage)
+  {
+    for (int y = region.y; y < region.y + region.height; ++y)
+    {
+      for (int x = region.x; x < region.x + region.width; ++x)
+      {
+        layer.mask[x + y * width_] = src[x + y * width_].A >= 128 ? 0xFF : 0x00;
+      }
+    }
+  }
+
+  layer.canvas.clearDamage();
+}
+
+const Image& Compositor::compose()
+{
+  for (auto& layer : layers_)
+  {
+    if (layer.canvas.width() != width_ || layer.canvas.height() != height_)
+    {
+      throw std::runtime_error("Compositor layers must not be resized, use setLayer instead");
+    }
+    if (!layer.canvas.damage().empty())
+    {
+      convert(layer);
+    }
+  }
+
+  // Select each layer's pixels over the ones below, 8 pixels at a time
+  IndexedColor white = colorMap_.toIndexedColor(ColorName::White);
+  std::memset(frame_.data(), white, width_ * height_);
+  size_t count = (size_t)width_ * height_;
+  for (const auto& layer : layers_)
+  {
+    if (!layer.visible)
+    {
+      continue;
+    }
+    uint8_t* dst = frame_.data();
+    const uint8_t* src = layer.converted.data();
+    const uint8_t* mask = layer.mask.data();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+      uint64_t m, s, d;
+      std::memcpy(&m, mask + i, sizeof(m));
+      if (m == 0)
+      {
+        continue;
+      }
+      std::memcpy(&s, src + i, sizeof(s));
+      std::memcpy(&d, dst + i, sizeof(d));
+      d = (d & ~m) | (s & m);
+      std::memcpy(dst + i, &d, sizeof(d));
+    }
+    for (; i < count; ++i)
+    {
+      if (mask[i])
+      {
+        dst[i] = src[i];
+      }
+    }
+  }
+
+  return frame_;
+}
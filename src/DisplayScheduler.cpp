@@ -0,0 +1,150 @@
+#include "DisplayScheduler.hpp"
+
+DisplayScheduler::DisplayScheduler(Inky& display, DisplaySchedulerSettings settings) :
+  display_(display),
+  settings_(settings)
+{
+  lastRefreshEnd_ = std::chrono::steady_clock::now() - settings_.minRefreshInterval;
+  worker_ = std::thread(&DisplayScheduler::run, this);
+}
+
+DisplayScheduler::~DisplayScheduler()
+{
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+    changed_.notify_all();
+  }
+  worker_.join();
+}
+
+void DisplayScheduler::submit(const Image& image, RefreshPriority priority, ScaleSettings scale, DitherSettings dither)
+{
+  enqueue({
+    .priority = priority,
+    .op = Inky::ShowOperation::BufferedImage,
+    .force = false,
+    .image = image,
+    .scale = scale,
+    .dither = dither
+  });
+}
+
+void DisplayScheduler::submit(Inky::ShowOperation op, RefreshPriority priority, bool force)
+{
+  enqueue({
+    .priority = priority,
+    .op = op,
+    .force = force
+  });
+}
+
+void DisplayScheduler::enqueue(Request request)
+{
+  std::lock_guard lock(mutex_);
+  ++stats_.submitted;
+  if (pending_ && pending_->priority > request.priority)
+  {
+    if (followUp_)
+    {
+      ++stats_.dropped;
+    }
+    followUp_ = std::move(request);
+  }
+  else
+  {
+    if (pending_ && pending_->priority < request.priority && !followUp_)
+    {
+      followUp_ = std::move(pending_);
+    }
+    else if (pending_)
+    {
+      ++stats_.dropped;
+    }
+    pending_ = std::move(request);
+  }
+  stats_.queueDepth = (pending_ ? 1 : 0) + (followUp_ ? 1 : 0);
+  changed_.notify_all();
+}
+
+DisplayScheduler::Stats DisplayScheduler::stats() const
+{
+  std::lock_guard lock(mutex_);
+  return stats_;
+}
+
+void DisplayScheduler::run()
+{
+  std::unique_lock lock(mutex_);
+  while (true)
+  {
+    // Wait for a request, then for the panel to have rested long enough.
+    // The request can still be replaced during the rest.
+    changed_.wait(lock, [&]
+    {
+      return stop_ || pending_;
+    });
+    changed_.wait_until(lock, lastRefreshEnd_ + settings_.minRefreshInterval, [&]
+    {
+      return stop_;
+    });
+    if (stop_)
+    {
+      break;
+    }
+
+    Request request = std::move(*pending_);
+    pending_ = std::move(followUp_);
+    followUp_.reset();
+    stats_.queueDepth = pending_ ? 1 : 0;
+    stats_.refreshing = true;
+    lock.unlock();
+
+    std::string error;
+    bool refreshed = false;
+    try
+    {
+      if (request.image)
+      {
+        display_.setImage(*request.image, request.scale, request.dither);
+      }
+      uint64_t skipped = display_.skippedRefreshes();
+      display_.show(request.op, request.force);
+      refreshed = display_.skippedRefreshes() == skipped;
+      // show can return while the glass is still updating, and the rest starts once it's done
+      if (refreshed)
+      {
+        display_.waitForRefresh();
+      }
+    }
+    catch (const std::exception& e)
+    {
+      error = e.what();
+    }
+    catch (...)
+    {
+      error = "Unknown error!";
+    }
+
+    lock.lock();
+    stats_.refreshing = false;
+    if (error.empty())
+    {
+      ++stats_.completed;
+    }
+    else
+    {
+      ++stats_.failed;
+      stats_.lastError = error;
+    }
+    if (refreshed && error.empty())
+    {
+      lastRefreshEnd_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  stats_.dropped += (pending_ ? 1 : 0) + (followUp_ ? 1 : 0);
+  pending_.reset();
+  followUp_.reset();
+  stats_.queueDepth = 0;
+}
@@ -2,6 +2,9 @@
 #include <limits>
 #include <stdexcept>
 #include <map>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
 static const uint8_t ditherLut[] 
 {
@@ -111,12 +114,10 @@ static void checkDitherSrcDest(const Image& sourceImage, Image& destImage)
   }
 }
 
-void patternDither(const Image& sourceImage, Image& destImage)
+// Pattern dither just the pixels inside region
+static void patternDitherRegion(const Image& sourceImage, Image& destImage, const BoundingBox& region)
 {
-  checkDitherSrcDest(sourceImage, destImage);
-
   int width = sourceImage.width();
-  int height = sourceImage.height();
   const RGBAColor* dataRGBA = (const RGBAColor*)sourceImage.data();
   uint8_t* dataInky = destImage.data();
 
@@ -124,49 +125,51 @@ void patternDither(const Image& sourceImage, Image& destImage)
   IndexedColor white = destImage.colorMap().toIndexedColor(ColorName::White);
 
   // Iterate over all the color data, just converting to black and white
-  for (int y=0; y < height; ++y)
+  for (int y=region.y; y < region.y + region.height; ++y)
   {
-    for (int x=0; x < width; ++x)
+    for (int x=region.x; x < region.x + region.width; ++x)
     {
-      int lutOffset = ((int)dataRGBA->getGrayValue() + 0x08) & 0x1F0;
+      int lutOffset = ((int)dataRGBA[x+y*width].getGrayValue() + 0x08) & 0x1F0;
       if (ditherLut[lutOffset + (y%4)*4+(x%4)])
       {
-        (*dataInky) = white;
+        dataInky[x+y*width] = white;
       }
       else
       {
-        (*dataInky) = black;
+        dataInky[x+y*width] = black;
       }
-      ++dataInky;
-      ++dataRGBA;
     }
   }
 }
 
-static std::vector<LabColor> getLabVector(const Image& sourceImage, PixelFormat destFormat)
+void patternDither(const Image& sourceImage, Image& destImage)
+{
+  checkDitherSrcDest(sourceImage, destImage);
+  patternDitherRegion(sourceImage, destImage, sourceImage.bounds());
+}
+
+void patternDither(const Image& sourceImage, const IndexedColorMap& colorMap, const DitherRowSink& sink)
 {
   if (sourceImage.format() != PixelFormat::RGBA)
   {
     throw std::invalid_argument("Source image format must be RGBA");
   }
 
-  if (destFormat != PixelFormat::IndexedColor)
-  {
-    throw std::invalid_argument("Dest image format must be an indexed format!");
-  }
-
-  // Copy the source image to a float array for convenience
-  // (the algorithm later will want to treat the values as floats)
-  std::vector<LabColor> labVals(sourceImage.width()*sourceImage.height());
-  
+  int width = sourceImage.width();
   const RGBAColor* dataRGBA = (const RGBAColor*)sourceImage.data();
-  // Yellow and red accents work best right on the color image
-  for (int i=0; i < labVals.size(); ++i)
+  IndexedColor black = colorMap.toIndexedColor(ColorName::Black);
+  IndexedColor white = colorMap.toIndexedColor(ColorName::White);
+
+  std::vector<IndexedColor> row(width);
+  for (int y=0; y < sourceImage.height(); ++y)
   {
-    labVals[i] = dataRGBA[i].toLab();
+    for (int x=0; x < width; ++x)
+    {
+      int lutOffset = ((int)dataRGBA[x+y*width].getGrayValue() + 0x08) & 0x1F0;
+      row[x] = ditherLut[lutOffset + (y%4)*4+(x%4)] ? white : black;
+    }
+    sink(y, row.data());
   }
-  
-  return labVals;
 }
 
 void diffuseError_dk(std::vector<LabColor>& labVals, const LabColor& oldValue, const LabColor& error, const int x, const int y, const int width, const int height)
@@ -314,28 +317,312 @@ void diffusionDither(const Image& sourceImage, Image& destImage, float ditherAcc
 {
   checkDitherSrcDest(sourceImage, destImage);
 
+  int width = sourceImage.width();
+  uint8_t* dataInky = destImage.data();
+  diffusionDither(sourceImage, destImage.colorMap(), [&](int y, const IndexedColor* row)
+  {
+    std::memcpy(dataInky + y * width, row, width);
+  }, ditherAccuracy);
+}
+
+void diffusionDither(const Image& sourceImage, const IndexedColorMap& colorMap, const DitherRowSink& sink, float ditherAccuracy)
+{
+  if (sourceImage.format() != PixelFormat::RGBA)
+  {
+    throw std::invalid_argument("Source image format must be RGBA");
+  }
+
   int width = sourceImage.width();
   int height = sourceImage.height();
-  PixelFormat format = destImage.format();
-  
-  // Get the source image data in LAB color format
-  std::vector<LabColor> labVals = getLabVector(sourceImage, destImage.format());
+  const RGBAColor* dataRGBA = (const RGBAColor*)sourceImage.data();
+
+  // Error only ever moves one row down, so just the current and next rows are kept in LAB.
+  // The next row starts as its source color and collects error in the same order as a
+  // full frame buffer would, so the result is identical.
+  std::vector<LabColor> labVals(width * 2);
+  std::vector<IndexedColor> row(width);
+  for (int x=0; x < width && height > 0; ++x)
+  {
+    labVals[x] = dataRGBA[x].toLab();
+  }
 
   // Convert to Inky using Floyd-Steinberg dithering
-  uint8_t* dataInky = destImage.data();
-  const IndexedColorMap& colorMap = destImage.colorMap();
   LabColor error, oldValue;
   for (int y=0; y < height; ++y)
   {
+    bool lastRow = y == height-1;
+    for (int x=0; x < width && !lastRow; ++x)
+    {
+      labVals[x+width] = dataRGBA[x+(y+1)*width].toLab();
+    }
+
     for (int x=0; x < width; ++x)
     {
-      oldValue = labVals[x+y*width];
-      (*dataInky) = colorMap.toIndexedColor(oldValue, error);
+      oldValue = labVals[x];
+      row[x] = colorMap.toIndexedColor(oldValue, error);
       error = error * ditherAccuracy;
 
-      diffuseError(labVals, oldValue, error, x, y, width, height);
-      
-      ++dataInky;
+      diffuseError(labVals, oldValue, error, x, 0, width, lastRow ? 1 : 2);
+    }
+    sink(y, row.data());
+
+    std::copy(labVals.begin() + width, labVals.end(), labVals.begin());
+  }
+}
+
+IncrementalDither::IncrementalDither(float convergenceEpsilon) :
+  convergenceEpsilon_(convergenceEpsilon)
+{
+}
+
+void IncrementalDither::reset()
+{
+  valid_ = false;
+  source_ = Image();
+  result_ = Image();
+  lab_.clear();
+  rowInput_.clear();
+}
+
+int IncrementalDither::lastRowsDithered() const
+{
+  return lastRowsDithered_;
+}
+
+int IncrementalDither::lastPixelsDithered() const
+{
+  return lastPixelsDithered_;
+}
+
+bool IncrementalDither::sameFrameSetup(const Image& source, const IndexedColorMap& colorMap, const DitherSettings& settings) const
+{
+  if (!valid_ ||
+      source.width() != source_.width() || source.height() != source_.height() ||
+      settings.ditherMode != settings_.ditherMode || settings.ditherAccuracy != settings_.ditherAccuracy)
+  {
+    return false;
+  }
+
+  const IndexedColorMap& previous = result_.colorMap();
+  if (colorMap.indexedColors() != previous.indexedColors())
+  {
+    return false;
+  }
+  for (auto index : colorMap.indexedColors())
+  {
+    RGBAColor a = colorMap.toRGBAColor(index);
+    RGBAColor b = previous.toRGBAColor(index);
+    if (a.R != b.R || a.G != b.G || a.B != b.B)
+    {
+      return false;
     }
   }
+  return true;
 }
+
+// Dither one row from its cached input and build the next row's input in nextRow.
+// Pixels outside [freeStart, freeEnd) keep their previous color and diffuse the error against it,
+// so differences in the error decay instead of flipping pixels that didn't change.
+// Accumulates in the same order as diffuseError so a full frame matches diffusionDither exactly.
+void IncrementalDither::ditherDiffusionRow(int y, int freeStart, int freeEnd, float ditherAccuracy, std::vector<LabColor>& nextRow)
+{
+  int width = source_.width();
+  int height = source_.height();
+  const IndexedColorMap& colorMap = result_.colorMap();
+  IndexedColor* dataInky = result_.data() + y * width;
+  const LabColor* rowIn = rowInput_.data() + y * width;
+
+  bool lastRow = (y == height - 1);
+  if (!lastRow)
+  {
+    std::copy(lab_.begin() + (y+1) * width, lab_.begin() + (y+2) * width, nextRow.begin());
+  }
+
+  LabColor fromLeft, error, oldValue;
+  for (int x=0; x < width; ++x)
+  {
+    oldValue = (x > 0) ? rowIn[x] + fromLeft : rowIn[x];
+    if (x >= freeStart && x < freeEnd)
+    {
+      dataInky[x] = colorMap.toIndexedColor(oldValue, error);
+    }
+    else
+    {
+      error = oldValue - colorMap.toLabColor(dataInky[x]);
+    }
+    error = error * ditherAccuracy;
+
+    if (x < width-1)
+      fromLeft = error * (7.0f / 16.0f);
+    if (!lastRow)
+    {
+      if (x > 0)
+        nextRow[x-1] += error * (3.0f / 16.0f);
+      nextRow[x] += error * (5.0f / 16.0f);
+      if (x < width-1)
+        nextRow[x+1] += error * (1.0f / 16.0f);
+    }
+  }
+}
+
+const Image& IncrementalDither::dither(const Image& source, const IndexedColorMap& colorMap, DitherSettings settings)
+{
+  if (source.format() != PixelFormat::RGBA)
+  {
+    throw std::invalid_argument("Source image format must be RGBA");
+  }
+
+  int width = source.width();
+  int height = source.height();
+  bool fullFrame = !sameFrameSetup(source, colorMap, settings);
+
+  // Work out which pixels changed since the last frame, as one span per row
+  std::vector<int> changedStart(height, width);
+  std::vector<int> changedEnd(height, 0);
+  if (fullFrame)
+  {
+    source_ = Image(width, height);
+    result_ = Image(width, height, colorMap);
+    if (settings.ditherMode == DitherMode::Diffusion)
+    {
+      lab_.assign(width * height, LabColor());
+      rowInput_.assign(width * height, LabColor());
+    }
+    settings_ = settings;
+    std::fill(changedStart.begin(), changedStart.end(), 0);
+    std::fill(changedEnd.begin(), changedEnd.end(), width);
+  }
+  else
+  {
+    std::vector<BoundingBox> candidates = source.damageTracking() ? source.damage() : std::vector<BoundingBox>{source.bounds()};
+    const RGBAColor* newData = (const RGBAColor*)source.data();
+    const RGBAColor* oldData = (const RGBAColor*)source_.data();
+    for (auto region : candidates)
+    {
+      region.clipTo(source.bounds());
+      for (int y=region.y; y < region.y + region.height; ++y)
+      {
+        const RGBAColor* newRow = newData + y * width;
+        const RGBAColor* oldRow = oldData + y * width;
+        if (memcmp(newRow + region.x, oldRow + region.x, region.width * sizeof(RGBAColor)) == 0)
+        {
+          continue;
+        }
+        for (int x=region.x; x < region.x + region.width; ++x)
+        {
+          if (memcmp(&newRow[x], &oldRow[x], sizeof(RGBAColor)) != 0)
+          {
+            changedStart[y] = std::min(changedStart[y], x);
+            changedEnd[y] = std::max(changedEnd[y], x + 1);
+          }
+        }
+      }
+    }
+  }
+
+  // Bring the cached source and Lab values up to date
+  const RGBAColor* newData = (const RGBAColor*)source.data();
+  RGBAColor* cachedData = (RGBAColor*)source_.data();
+  bool needLab = (settings.ditherMode == DitherMode::Diffusion);
+  for (int y=0; y < height; ++y)
+  {
+    for (int x=changedStart[y]; x < changedEnd[y]; ++x)
+    {
+      cachedData[x+y*width] = newData[x+y*width];
+      if (needLab)
+      {
+        lab_[x+y*width] = newData[x+y*width].toLab();
+      }
+    }
+  }
+
+  lastRowsDithered_ = 0;
+  lastPixelsDithered_ = 0;
+  if (settings.ditherMode == DitherMode::Pattern)
+  {
+    // Pattern dither has no state between pixels, so only the changed 4x4 tiles need redoing
+    for (int y=0; y < height; ++y)
+    {
+      if (changedStart[y] >= changedEnd[y])
+      {
+        continue;
+      }
+      BoundingBox tiles {changedStart[y] & ~3, y, ((changedEnd[y] + 3) & ~3) - (changedStart[y] & ~3), 1};
+      tiles.clipTo(source.bounds());
+      patternDitherRegion(source_, result_, tiles);
+      lastRowsDithered_++;
+      lastPixelsDithered_ += tiles.width;
+    }
+  }
+  else
+  {
+    int lastChangedRow = -1;
+    for (int y=0; y < height; ++y)
+    {
+      if (changedStart[y] < changedEnd[y])
+      {
+        lastChangedRow = y;
+      }
+    }
+
+    // Restart the diffusion at each changed row and run until the input handed to the
+    // next row matches what the previous frame handed it
+    std::vector<LabColor> nextRow(width);
+    int y = 0;
+    while (y <= lastChangedRow)
+    {
+      if (changedStart[y] >= changedEnd[y])
+      {
+        ++y;
+        continue;
+      }
+
+      // The row above is unchanged, but its error lands on this row's new Lab values
+      if (y == 0)
+      {
+        std::copy(lab_.begin(), lab_.begin() + width, rowInput_.begin());
+      }
+      else
+      {
+        ditherDiffusionRow(y-1, 0, 0, settings.ditherAccuracy, nextRow);
+        std::copy(nextRow.begin(), nextRow.end(), rowInput_.begin() + y * width);
+        lastRowsDithered_++;
+      }
+
+      for (; y < height; ++y)
+      {
+        ditherDiffusionRow(y, changedStart[y], changedEnd[y], settings.ditherAccuracy, nextRow);
+        lastRowsDithered_++;
+        if (y == height - 1)
+        {
+          break;
+        }
+
+        LabColor* cachedNextRow = rowInput_.data() + (y+1) * width;
+        bool converged = !fullFrame && changedStart[y+1] >= changedEnd[y+1];
+        for (int x=0; x < width && converged; ++x)
+        {
+          LabColor diff = nextRow[x] - cachedNextRow[x];
+          converged = std::abs(diff.L) < convergenceEpsilon_ &&
+                      std::abs(diff.a) < convergenceEpsilon_ &&
+                      std::abs(diff.b) < convergenceEpsilon_;
+        }
+        if (converged)
+        {
+          // Keep the cached inputs and pixels from here on
+          ++y;
+          break;
+        }
+        std::copy(nextRow.begin(), nextRow.end(), cachedNextRow);
+      }
+      if (y == height - 1)
+      {
+        break;
+      }
+    }
+    lastPixelsDithered_ = lastRowsDithered_ * width;
+  }
+
+  valid_ = true;
+  return result_;
+}
\ No newline at end of file
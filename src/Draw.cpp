@@ -1,14 +1,90 @@
+// Hack to fix intellisense with some arm NEON code
+#if __INTELLISENSE__
+#undef __ARM_NEON
+#undef __ARM_NEON__
+#endif
+
 #include "Draw.hpp"
 #include "Dither.hpp"
-#include <unordered_map>
+#include "FontData.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
 #include <ImageIO.hpp>
+#include <fmt/format.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 namespace Draw
 {
 
-static Image loadFont(const std::string& path)
+// Packed 1-bit glyphs for a 16x16 grid of 256 characters
+struct FontGlyphs
+{
+  int charWidth;
+  int charHeight;
+  // charHeight rows per character, bit 0 of each row is the leftmost pixel
+  const uint32_t* rows;
+};
+
+// Built-in fonts are generated from resources/font_*.png at build time
+static constexpr FontGlyphs BuiltinFonts[] =
+{
+  {FontData::Mono_4x6_CharWidth, FontData::Mono_4x6_CharHeight, FontData::Mono_4x6_Rows},
+  {FontData::Mono_6x6_CharWidth, FontData::Mono_6x6_CharHeight, FontData::Mono_6x6_Rows},
+  {FontData::Mono_8x12_CharWidth, FontData::Mono_8x12_CharHeight, FontData::Mono_8x12_Rows},
+  {FontData::Mono_32x48_CharWidth, FontData::Mono_32x48_CharHeight, FontData::Mono_32x48_Rows},
+};
+
+static constexpr int BuiltinFontCount = sizeof(BuiltinFonts) / sizeof(BuiltinFonts[0]);
+
+// Fonts loaded at runtime, a deque so glyph references stay valid as fonts are added
+struct UserFont
 {
-  static IndexedColorMap colorMap(
+  FontGlyphs glyphs;
+  std::vector<uint32_t> rows;
+};
+
+static std::mutex& userFontsMutex()
+{
+  static std::mutex mutex;
+  return mutex;
+}
+
+static std::deque<UserFont>& userFonts()
+{
+  static std::deque<UserFont> fonts;
+  return fonts;
+}
+
+static const FontGlyphs& getFont(Font font)
+{
+  int id = (int)font;
+  if (id >= 0 && id < BuiltinFontCount)
+  {
+    return BuiltinFonts[id];
+  }
+
+  std::lock_guard lock(userFontsMutex());
+  auto& fonts = userFonts();
+  if (id < BuiltinFontCount || id - BuiltinFontCount >= (int)fonts.size())
+  {
+    throw std::invalid_argument(fmt::format("Unknown font id {}", id));
+  }
+  return fonts[id - BuiltinFontCount].glyphs;
+}
+
+Font LoadFont(const std::string& path)
+{
+  static const IndexedColorMap colorMap(
   {
         {ColorName::Black, 0, {0,0,0}},
         {ColorName::White, 1, {255,255,255}}
@@ -16,47 +92,152 @@ static Image loadFont(const std::string& path)
   Image font = ImageIO::LoadFromFile(path);
   // Create a binarized index image of the font
   font.toIndexed(colorMap, {.ditherAccuracy = 0.0f});
-  return font;
+
+  int charWidth = font.width() / 16;
+  int charHeight = font.height() / 16;
+  if (charWidth < 1 || charHeight < 1 || charWidth > 32)
+  {
+    throw std::runtime_error(fmt::format("Font {} must be a 16x16 grid of characters at most 32 pixels wide", path));
+  }
+
+  // Pack each glyph row in to bits, matching the layout of the built-in fonts
+  UserFont userFont;
+  userFont.rows.resize(256 * charHeight);
+  const IndexedColor* fontData = (const IndexedColor*)font.data();
+  for (int ch = 0; ch < 256; ++ch)
+  {
+    int charOffsetX = (ch % 16) * charWidth;
+    int charOffsetY = (ch / 16) * charHeight;
+    for (int iY = 0; iY < charHeight; ++iY)
+    {
+      uint32_t bits = 0;
+      for (int iX = 0; iX < charWidth; ++iX)
+      {
+        if (fontData[iX+charOffsetX+(iY+charOffsetY)*font.width()] != 0)
+        {
+          bits |= 1u << iX;
+        }
+      }
+      userFont.rows[ch*charHeight+iY] = bits;
+    }
+  }
+
+  std::lock_guard lock(userFontsMutex());
+  auto& fonts = userFonts();
+  auto& added = fonts.emplace_back(std::move(userFont));
+  added.glyphs = {charWidth, charHeight, added.rows.data()};
+  return (Font)(BuiltinFontCount + (int)fonts.size() - 1);
 }
 
-// Static resoures for drawing text on to images
-const static std::unordered_map<Font, Image> Fonts
+// Each bit of a byte expanded to a 0x00/0xFF byte, bit 0 in the lowest address on little endian targets
+static constexpr std::array<uint64_t, 256> ByteMasks = []
 {
-  {Font::Mono_4x6,  loadFont("resources/font_4x6.png")},
-  {Font::Mono_6x6,  loadFont("resources/font_6x6.png")},
-  {Font::Mono_8x12, loadFont("resources/font_8x12.png")},
-  {Font::Mono_32x48, loadFont("resources/font_32x48.png")},
-};
+  std::array<uint64_t, 256> masks {};
+  for (int i = 0; i < 256; ++i)
+  {
+    for (int bit = 0; bit < 8; ++bit)
+    {
+      if (i & (1 << bit))
+      {
+        masks[i] |= 0xFFull << (bit * 8);
+      }
+    }
+  }
+  return masks;
+}();
 
-template <typename PixelType>
-static inline void characterBlit(const char character, const int x, const int y, const PixelType& color,
-                                 const IndexedColor* fontData, const int charWidth, const int charHeight, const int fontWidth,
-                                 PixelType* destData, BoundingBox& destBox)
+// Write color to the first count pixels of dest wherever the matching bit of bits is set
+static inline void spanBlit(IndexedColor* dest, uint32_t bits, const int count, const IndexedColor color)
 {
-  // Create a bounding box for the character we want to blit
-  BoundingBox charBox {0, 0, charWidth, charHeight};
-  int charOffsetX = (character % 16) * charWidth;
-  int charOffsetY = (character / 16) * charHeight;
+  const uint64_t color8 = 0x0101010101010101ull * color;
+  int i = 0;
+  for (; i + 8 <= count; i += 8, bits >>= 8)
+  {
+    uint64_t mask = ByteMasks[bits & 0xFF];
+    if (mask != 0)
+    {
+      uint64_t pixels;
+      std::memcpy(&pixels, dest + i, sizeof(pixels));
+      pixels = (pixels & ~mask) | (color8 & mask);
+      std::memcpy(dest + i, &pixels, sizeof(pixels));
+    }
+  }
+  for (; i < count; ++i, bits >>= 1)
+  {
+    if (bits & 1)
+    {
+      dest[i] = color;
+    }
+  }
+}
 
-  // Move the dest box so that the charBox is in the right place on the image
-  destBox.x = -x;
-  destBox.y = -y;
+static inline void spanBlit(RGBAColor* dest, uint32_t bits, const int count, const RGBAColor color)
+{
+  int i = 0;
+#if defined(__SSE2__)
+  uint32_t colorBits;
+  std::memcpy(&colorBits, &color, sizeof(colorBits));
+  const __m128i color4 = _mm_set1_epi32((int)colorBits);
+  const __m128i lanes = _mm_setr_epi32(1, 2, 4, 8);
+  for (; i + 4 <= count; i += 4, bits >>= 4)
+  {
+    if (bits & 0xF)
+    {
+      // Select color in the lanes whose bit is set, keep the existing pixel elsewhere
+      __m128i mask = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32((int)bits), lanes), lanes);
+      __m128i pixels = _mm_loadu_si128((const __m128i*)(dest + i));
+      pixels = _mm_or_si128(_mm_and_si128(mask, color4), _mm_andnot_si128(mask, pixels));
+      _mm_storeu_si128((__m128i*)(dest + i), pixels);
+    }
+  }
+#elif defined(__ARM_NEON)
+  uint32_t colorBits;
+  std::memcpy(&colorBits, &color, sizeof(colorBits));
+  const uint32x4_t color4 = vdupq_n_u32(colorBits);
+  const uint32_t laneBits[4] = {1, 2, 4, 8};
+  const uint32x4_t lanes = vld1q_u32(laneBits);
+  for (; i + 4 <= count; i += 4, bits >>= 4)
+  {
+    if (bits & 0xF)
+    {
+      // Select color in the lanes whose bit is set, keep the existing pixel elsewhere
+      uint32x4_t mask = vtstq_u32(vdupq_n_u32(bits), lanes);
+      uint32x4_t pixels = vld1q_u32((const uint32_t*)(dest + i));
+      vst1q_u32((uint32_t*)(dest + i), vbslq_u32(mask, color4, pixels));
+    }
+  }
+#endif
+  for (; i < count; ++i, bits >>= 1)
+  {
+    if (bits & 1)
+    {
+      dest[i] = color;
+    }
+  }
+}
 
-  // Clip the char box to the dest box
-  charBox.clipTo(destBox);
+template <typename PixelType>
+static inline void textBlit(const std::string& str, const int x, const int y, const PixelType& color,
+                            const FontGlyphs& font, const BoundingBox& run, PixelType* destData, const int destWidth)
+{
+  // Only the characters overlapping the clipped run need visiting
+  const int firstChar = (run.x - x) / font.charWidth;
+  const int lastChar = (run.x + run.width - 1 - x) / font.charWidth;
 
-  // Check if there's any blittable area left
-  if (charBox.width > 0 && charBox.height > 0)
+  // Walk the run a row at a time so the destination is written sequentially
+  for (int iY = run.y; iY < run.y + run.height; ++iY)
   {
-    // Now it should be safe to blindly blit the charBox on to destData
-    for (int iY = 0; iY < charBox.height; ++iY)
+    const int glyphY = iY - y;
+    PixelType* destRow = destData + iY * destWidth;
+    for (int iC = firstChar; iC <= lastChar; ++iC)
     {
-      for (int iX = 0; iX < charBox.width; ++iX)
+      const int charX = x + iC * font.charWidth;
+      const int spanStart = std::max(charX, run.x);
+      const int spanEnd = std::min(charX + font.charWidth, run.x + run.width);
+      uint32_t bits = font.rows[(uint8_t)str[iC] * font.charHeight + glyphY] >> (spanStart - charX);
+      if (bits != 0)
       {
-        if (fontData[iX+charOffsetX+charBox.x+(iY+charOffsetY+charBox.y)*fontWidth] != 0)
-        {
-          destData[iX+charBox.x+x+(iY+charBox.y+y)*destBox.width] = color;
-        }
+        spanBlit(destRow + spanStart, bits, spanEnd - spanStart, color);
       }
     }
   }
@@ -64,9 +245,9 @@ static inline void characterBlit(const char character, const int x, const int y,
 
 void Text(Image& dest, int x, int y, const std::string& str, TextStyle style)
 {
-  const Image& font = Fonts.at(style.font);
-  int charWidth = font.width() / 16;
-  int charHeight = font.height() / 16;
+  const FontGlyphs& font = getFont(style.font);
+  int charWidth = font.charWidth;
+  int charHeight = font.charHeight;
 
   if (style.hAlign == HAlign::Center)
   {
@@ -86,54 +267,246 @@ void Text(Image& dest, int x, int y, const std::string& str, TextStyle style)
     y -= charHeight;
   }
 
+  // Clip the whole string once, then blit only what's left of it
+  BoundingBox run {x, y, (int)str.size() * charWidth, charHeight};
+  run.clipTo(dest.bounds());
+  if (run.width <= 0 || run.height <= 0)
+  {
+    return;
+  }
+  dest.addDamage(run);
+
   if (dest.format() == PixelFormat::RGBA)
   {
-    RGBAColor* destData = (RGBAColor*)dest.data();
-    BoundingBox destBox = dest.bounds();
-    for (const auto& ch : str)
+    textBlit<RGBAColor>(str, x, y, style.color, font, run, (RGBAColor*)dest.data(), dest.width());
+  }
+  else
+  {
+    IndexedColor color = dest.colorMap().toIndexedColor(style.color);
+    textBlit<IndexedColor>(str, x, y, color, font, run, (IndexedColor*)dest.data(), dest.width());
+  }
+}
+
+static inline void fillSpan(IndexedColor* dest, const int count, const IndexedColor color)
+{
+  std::memset(dest, color, count);
+}
+
+static inline void fillSpan(RGBAColor* dest, const int count, const RGBAColor color)
+{
+  int i = 0;
+#if defined(__SSE2__)
+  uint32_t colorBits;
+  std::memcpy(&colorBits, &color, sizeof(colorBits));
+  const __m128i color4 = _mm_set1_epi32((int)colorBits);
+  for (; i + 4 <= count; i += 4)
+  {
+    _mm_storeu_si128((__m128i*)(dest + i), color4);
+  }
+#elif defined(__ARM_NEON)
+  uint32_t colorBits;
+  std::memcpy(&colorBits, &color, sizeof(colorBits));
+  const uint32x4_t color4 = vdupq_n_u32(colorBits);
+  for (; i + 4 <= count; i += 4)
+  {
+    vst1q_u32((uint32_t*)(dest + i), color4);
+  }
+#endif
+  std::fill_n(dest + i, count - i, color);
+}
+
+// Writes horizontal spans of a single color, clipped to a box computed once per shape
+template <typename PixelType>
+struct SpanFill
+{
+  PixelType* data;
+  int stride;
+  BoundingBox clip;
+  PixelType color;
+
+  // Fill [x0, x1) on row y
+  inline void span(int y, int x0, int x1) const
+  {
+    if (y < clip.y || y >= clip.y + clip.height)
+    {
+      return;
+    }
+    x0 = std::max(x0, clip.x);
+    x1 = std::min(x1, clip.x + clip.width);
+    if (x0 < x1)
     {
-      characterBlit<RGBAColor>(ch, x, y, style.color,
-                                 (IndexedColor*)font.data(), charWidth, charHeight, font.width(),
-                                 destData, destBox);
-      x += charWidth;
+      fillSpan(data + y * stride + x0, x1 - x0, color);
     }
   }
+};
+
+// Clip the shape bounds to the image and hand the shape a span writer for the image's pixel format
+template <typename Shape>
+static void rasterize(Image& dest, BoundingBox shapeBounds, const RGBAColor& color, Shape&& shape)
+{
+  shapeBounds.clipTo(dest.bounds());
+  if (shapeBounds.width <= 0 || shapeBounds.height <= 0)
+  {
+    return;
+  }
+  dest.addDamage(shapeBounds);
+
+  if (dest.format() == PixelFormat::RGBA)
+  {
+    shape(SpanFill<RGBAColor>{(RGBAColor*)dest.data(), dest.width(), shapeBounds, color});
+  }
   else
   {
-    IndexedColor* destData = (IndexedColor*)dest.data();
-    IndexedColor color = dest.colorMap().toIndexedColor(style.color);
-    BoundingBox destBox = dest.bounds();
-    for (const auto& ch : str)
+    IndexedColor indexedColor = dest.colorMap().toIndexedColor(color);
+    shape(SpanFill<IndexedColor>{(IndexedColor*)dest.data(), dest.width(), shapeBounds, indexedColor});
+  }
+}
+
+// A box with elliptical corners. Boxes, rounded rects, circles and ellipses are all this shape.
+struct RoundedShape
+{
+  int x;
+  int y;
+  int width;
+  int height;
+  int radiusX;
+  int radiusY;
+
+  // Half width of a corner ellipse dy rows away from its center row
+  static int halfWidth(int radiusX, int radiusY, int dy)
+  {
+    if (radiusY == 0)
     {
-      characterBlit<IndexedColor>(ch, x, y, color,
-                                (IndexedColor*)font.data(), charWidth, charHeight, font.width(),
-                                destData, destBox);
-      x += charWidth;
+      return radiusX;
     }
+    double a = radiusX + 0.5;
+    double b = radiusY + 0.5;
+    double t = 1.0 - ((double)dy * dy) / (b * b);
+    return t > 0.0 ? (int)(a * std::sqrt(t)) : 0;
+  }
+
+  bool empty() const
+  {
+    return width <= 0 || height <= 0;
+  }
+
+  // The columns [x0, x1) covered on image row iY, which must be within the shape
+  void rowSpan(int iY, int& x0, int& x1) const
+  {
+    int row = iY - y;
+    int dy = 0;
+    if (row < radiusY)
+    {
+      dy = radiusY - row;
+    }
+    else if (row > height - 1 - radiusY)
+    {
+      dy = row - (height - 1 - radiusY);
+    }
+    int dx = halfWidth(radiusX, radiusY, dy);
+    x0 = x + radiusX - dx;
+    x1 = x + width - radiusX + dx;
+  }
+
+  // The same shape shrunk by thickness on every side
+  RoundedShape inset(int thickness) const
+  {
+    return {x + thickness, y + thickness, width - 2 * thickness, height - 2 * thickness,
+            std::max(radiusX - thickness, 0), std::max(radiusY - thickness, 0)};
   }
+};
+
+static RoundedShape roundedShape(int x, int y, int width, int height, int radiusX, int radiusY)
+{
+  // Keep the corners from overlapping
+  radiusX = std::clamp(radiusX, 0, std::max((width - 1) / 2, 0));
+  radiusY = std::clamp(radiusY, 0, std::max((height - 1) / 2, 0));
+  return {x, y, width, height, radiusX, radiusY};
 }
 
-template <typename PixelType>
-static inline void fill(BoundingBox fillArea, const PixelType& color, PixelType* destData, const BoundingBox& destBox)
+// Fill a rounded shape, or only its outline when outline > 0
+static void drawRoundedShape(Image& dest, const RoundedShape& outer, int outline, const RGBAColor& color)
 {
-  // Clip the char box to the dest box
-  fillArea.clipTo(destBox);
+  if (outer.empty())
+  {
+    return;
+  }
+
+  RoundedShape inner = outer.inset(outline);
+  bool hollow = outline > 0 && !inner.empty();
 
-  // Check if there's any blittable area left
-  if (fillArea.width > 0 && fillArea.height > 0)
+  rasterize(dest, {outer.x, outer.y, outer.width, outer.height}, color, [&](const auto& fill)
   {
-    // Now it should be safe to blindly blit the charBox on to destData
-    for (int iY = 0; iY < fillArea.height; ++iY)
+    for (int iY = fill.clip.y; iY < fill.clip.y + fill.clip.height; ++iY)
     {
-      for (int iX = 0; iX < fillArea.width; ++iX)
+      int x0, x1;
+      outer.rowSpan(iY, x0, x1);
+      if (hollow && iY >= inner.y && iY < inner.y + inner.height)
       {
-        //if ()
-        //{
-          destData[iX+fillArea.x+(iY+fillArea.y)*destBox.width] = color;
-        //}
+        // Leave the inside of the outline alone
+        int innerX0, innerX1;
+        inner.rowSpan(iY, innerX0, innerX1);
+        fill.span(iY, x0, innerX0);
+        fill.span(iY, innerX1, x1);
+      }
+      else
+      {
+        fill.span(iY, x0, x1);
       }
     }
+  });
+}
+
+struct PointF
+{
+  float x;
+  float y;
+};
+
+// Even-odd scanline fill sampled at pixel centers. Vertices are in pixel units, the center of pixel (0,0) is (0.5,0.5).
+static void fillPolygon(Image& dest, const std::vector<PointF>& points, const RGBAColor& color)
+{
+  if (points.size() < 3)
+  {
+    return;
+  }
+
+  float minX = points[0].x, maxX = points[0].x, minY = points[0].y, maxY = points[0].y;
+  for (const auto& p : points)
+  {
+    minX = std::min(minX, p.x);
+    maxX = std::max(maxX, p.x);
+    minY = std::min(minY, p.y);
+    maxY = std::max(maxY, p.y);
   }
+  BoundingBox bounds {(int)std::floor(minX), (int)std::floor(minY),
+                      (int)std::ceil(maxX) - (int)std::floor(minX) + 1, (int)std::ceil(maxY) - (int)std::floor(minY) + 1};
+
+  rasterize(dest, bounds, color, [&](const auto& fill)
+  {
+    std::vector<float> crossings;
+    for (int iY = fill.clip.y; iY < fill.clip.y + fill.clip.height; ++iY)
+    {
+      float sampleY = iY + 0.5f;
+      crossings.clear();
+      for (size_t i = 0; i < points.size(); ++i)
+      {
+        const PointF& a = points[i];
+        const PointF& b = points[(i + 1) % points.size()];
+        // Half open so a vertex on the sample row is only counted once
+        if ((a.y <= sampleY && b.y > sampleY) || (b.y <= sampleY && a.y > sampleY))
+        {
+          crossings.push_back(a.x + (sampleY - a.y) * (b.x - a.x) / (b.y - a.y));
+        }
+      }
+      std::sort(crossings.begin(), crossings.end());
+      for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+      {
+        // Pixels whose centers lie in [start, end)
+        fill.span(iY, (int)std::ceil(crossings[i] - 0.5f), (int)std::ceil(crossings[i + 1] - 0.5f));
+      }
+    }
+  });
 }
 
 void Box(Image& dest, int x, int y, int width, int height, BoxStyle style)
@@ -156,14 +529,131 @@ void Box(Image& dest, int x, int y, int width, int height, BoxStyle style)
     y -= height;
   }
 
-  if (dest.format() == PixelFormat::RGBA)
+  drawRoundedShape(dest, roundedShape(x, y, width, height, style.cornerRadius, style.cornerRadius), style.outline, style.color);
+}
+
+void Line(Image& dest, int x0, int y0, int x1, int y1, LineStyle style)
+{
+  if (style.thickness > 1)
   {
-    fill<RGBAColor>({x,y,width,height}, style.color, (RGBAColor*)dest.data(), dest.bounds());
+    // Thick lines are a quad around the segment with round caps
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float length = std::sqrt(dx * dx + dy * dy);
+    if (length > 0.0f)
+    {
+      float nx = -dy / length * style.thickness * 0.5f;
+      float ny = dx / length * style.thickness * 0.5f;
+      fillPolygon(dest, {{x0 + 0.5f + nx, y0 + 0.5f + ny},
+                         {x1 + 0.5f + nx, y1 + 0.5f + ny},
+                         {x1 + 0.5f - nx, y1 + 0.5f - ny},
+                         {x0 + 0.5f - nx, y0 + 0.5f - ny}}, style.color);
+    }
+    int radius = (style.thickness - 1) / 2;
+    drawRoundedShape(dest, roundedShape(x0 - radius, y0 - radius, radius * 2 + 1, radius * 2 + 1, radius, radius), 0, style.color);
+    drawRoundedShape(dest, roundedShape(x1 - radius, y1 - radius, radius * 2 + 1, radius * 2 + 1, radius, radius), 0, style.color);
+    return;
   }
-  else
+
+  BoundingBox bounds {std::min(x0, x1), std::min(y0, y1), std::abs(x1 - x0) + 1, std::abs(y1 - y0) + 1};
+  rasterize(dest, bounds, style.color, [&](const auto& fill)
   {
-    IndexedColor color = dest.colorMap().toIndexedColor(style.color);
-    fill<IndexedColor>({x,y,width,height}, color, (IndexedColor*)dest.data(), dest.bounds());
+    // Bresenham, emitting each horizontal run of pixels as one span
+    int dx = std::abs(x1 - x0);
+    int dy = -std::abs(y1 - y0);
+    int stepX = x0 < x1 ? 1 : -1;
+    int stepY = y0 < y1 ? 1 : -1;
+    int error = dx + dy;
+    int x = x0;
+    int y = y0;
+    int runStart = x0;
+    while (true)
+    {
+      bool done = (x == x1 && y == y1);
+      int e2 = 2 * error;
+      bool moveX = !done && e2 >= dy;
+      bool moveY = !done && e2 <= dx;
+      if (done || moveY)
+      {
+        fill.span(y, std::min(runStart, x), std::max(runStart, x) + 1);
+      }
+      if (done)
+      {
+        break;
+      }
+      if (moveX)
+      {
+        error += dy;
+        x += stepX;
+      }
+      if (moveY)
+      {
+        error += dx;
+        y += stepY;
+        runStart = x;
+      }
+    }
+  });
+}
+
+void Circle(Image& dest, int centerX, int centerY, int radius, ShapeStyle style)
+{
+  Ellipse(dest, centerX, centerY, radius, radius, style);
+}
+
+void Ellipse(Image& dest, int centerX, int centerY, int radiusX, int radiusY, ShapeStyle style)
+{
+  if (radiusX < 0 || radiusY < 0)
+  {
+    return;
+  }
+  drawRoundedShape(dest, roundedShape(centerX - radiusX, centerY - radiusY, radiusX * 2 + 1, radiusY * 2 + 1, radiusX, radiusY),
+                   style.outline, style.color);
+}
+
+void Polygon(Image& dest, const std::vector<Point>& points, ShapeStyle style)
+{
+  if (style.outline > 0)
+  {
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+      const Point& a = points[i];
+      const Point& b = points[(i + 1) % points.size()];
+      Line(dest, a.x, a.y, b.x, b.y, {.color = style.color, .thickness = style.outline});
+    }
+    return;
+  }
+
+  std::vector<PointF> centers;
+  centers.reserve(points.size());
+  for (const auto& p : points)
+  {
+    centers.push_back({p.x + 0.5f, p.y + 0.5f});
+  }
+  fillPolygon(dest, centers, style.color);
+}
+
+void Blit(Image& dest, int x, int y, const Image& src)
+{
+  if (src.format() != dest.format())
+  {
+    throw std::invalid_argument("Blit source and destination must have the same pixel format");
+  }
+
+  // Clip the source rect against the destination once, then copy whole rows
+  BoundingBox destArea {x, y, src.width(), src.height()};
+  destArea.clipTo(dest.bounds());
+  if (destArea.empty())
+  {
+    return;
+  }
+  dest.addDamage(destArea);
+
+  int bpp = dest.bytesPerPixel();
+  for (int iY = destArea.y; iY < destArea.y + destArea.height; ++iY)
+  {
+    const uint8_t* srcRow = src.data() + ((destArea.x - x) + (iY - y) * src.width()) * bpp;
+    std::memcpy(dest.data() + (destArea.x + iY * dest.width()) * bpp, srcRow, destArea.width * bpp);
   }
 }
 
@@ -0,0 +1,137 @@
+#include "Hash.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+static constexpr uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t Prime3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t Prime4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t Prime5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+// The format is defined little endian, which every target we build for is
+static inline uint64_t read64(const uint8_t* p)
+{
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t read32(const uint8_t* p)
+{
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t round(uint64_t acc, uint64_t input)
+{
+  acc += input * Prime2;
+  acc = rotl(acc, 31);
+  return acc * Prime1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t val)
+{
+  acc ^= round(0, val);
+  return acc * Prime1 + Prime4;
+}
+
+Hash64::Hash64(uint64_t seed) :
+  acc_{seed + Prime1 + Prime2, seed + Prime2, seed, seed - Prime1},
+  seed_(seed)
+{
+}
+
+void Hash64::update(std::span<const uint8_t> data)
+{
+  update(data.data(), data.size());
+}
+
+void Hash64::update(const void* data, size_t len)
+{
+  const uint8_t* p = (const uint8_t*)data;
+  totalLen_ += len;
+
+  // Top up a partial stripe left from the last call first
+  if (bufferLen_ > 0)
+  {
+    size_t fill = std::min(len, sizeof(buffer_) - bufferLen_);
+    std::memcpy(buffer_ + bufferLen_, p, fill);
+    bufferLen_ += fill;
+    p += fill;
+    len -= fill;
+    if (bufferLen_ < sizeof(buffer_))
+    {
+      return;
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+      acc_[i] = round(acc_[i], read64(buffer_ + i * 8));
+    }
+    bufferLen_ = 0;
+  }
+
+  // Whole 32 byte stripes go straight from the input
+  for (; len >= 32; p += 32, len -= 32)
+  {
+    acc_[0] = round(acc_[0], read64(p));
+    acc_[1] = round(acc_[1], read64(p + 8));
+    acc_[2] = round(acc_[2], read64(p + 16));
+    acc_[3] = round(acc_[3], read64(p + 24));
+  }
+
+  std::memcpy(buffer_, p, len);
+  bufferLen_ = len;
+}
+
+uint64_t Hash64::digest() const
+{
+  uint64_t h;
+  if (totalLen_ >= 32)
+  {
+    h = rotl(acc_[0], 1) + rotl(acc_[1], 7) + rotl(acc_[2], 12) + rotl(acc_[3], 18);
+    for (int i = 0; i < 4; ++i)
+    {
+      h = mergeRound(h, acc_[i]);
+    }
+  }
+  else
+  {
+    h = seed_ + Prime5;
+  }
+  h += totalLen_;
+
+  const uint8_t* p = buffer_;
+  size_t len = bufferLen_;
+  for (; len >= 8; p += 8, len -= 8)
+  {
+    h ^= round(0, read64(p));
+    h = rotl(h, 27) * Prime1 + Prime4;
+  }
+  if (len >= 4)
+  {
+    h ^= (uint64_t)read32(p) * Prime1;
+    h = rotl(h, 23) * Prime2 + Prime3;
+    p += 4;
+    len -= 4;
+  }
+  for (; len > 0; ++p, --len)
+  {
+    h ^= (*p) * Prime5;
+    h = rotl(h, 11) * Prime1;
+  }
+
+  // Final avalanche
+  h ^= h >> 33;
+  h *= Prime2;
+  h ^= h >> 29;
+  h *= Prime3;
+  h ^= h >> 32;
+  return h;
+}
@@ -10,6 +10,7 @@
 #include <string>
 #include <stdarg.h>
 #include <cmath>
+#include <algorithm>
 
 #include <base_resample.h>
 
@@ -69,6 +70,7 @@ void Image::toIndexed(Image &dest, IndexedColorMap colorMap, DitherSettings sett
     dest.height_ = height_;
     dest.format_ = PixelFormat::IndexedColor;
     dest.colorMap_ = colorMap;
+    dest.addDamage(dest.bounds());
     return;
   }
   // Conversion type 2: indexed to indexed (via RGBA)
@@ -195,6 +197,10 @@ void Image::rotateFlip(Image &dest, FlipRotateOperation op) const
   // Set the size and format on the destination image
   dest.format_ = format_;
 
+  if (!inPlace || op != FlipRotateOperation::None)
+  {
+    dest.addDamage(dest.bounds());
+  }
   return;
 }
 
@@ -233,6 +239,10 @@ void Image::toRGBA(Image &dest) const
   dest.width_ = width_;
   dest.height_ = height_;
   dest.format_ = PixelFormat::RGBA;
+  if (!inPlace || format_ != PixelFormat::RGBA)
+  {
+    dest.addDamage(dest.bounds());
+  }
   return;
 }
 
@@ -270,7 +280,8 @@ void Image::scale(Image &dest, int width, int height, ScaleSettings settings) co
     settings.interpolationMode = (width > width_) ? InterpolationMode::Bilinear : InterpolationMode::Gaussian;
   }
 
-  if (width == width_ && height == height_)
+  bool resized = (width != width_ || height != height_);
+  if (!resized)
   {
     // Image is the correct size already!
     // Just copy the data as-is
@@ -304,6 +315,10 @@ void Image::scale(Image &dest, int width, int height, ScaleSettings settings) co
   {
     dest.crop((uncroppedWidth - width) / 2, (uncroppedHeight - height) / 2, width, height, settings);
   }
+  else if (!inPlace || resized)
+  {
+    dest.addDamage(dest.bounds());
+  }
 }
 
 void Image::crop(int x, int y, int width, int height, ScaleSettings settings)
@@ -323,6 +338,7 @@ void Image::crop(Image &dest, int x, int y, int width, int height, ScaleSettings
       dest.height_ = height_;
       dest.format_ = format_;
       dest.data_ = data_;
+      dest.addDamage(dest.bounds());
     }
     return;
   }
@@ -371,6 +387,7 @@ void Image::crop(Image &dest, int x, int y, int width, int height, ScaleSettings
   dest.height_ = height;
   dest.format_ = format_;
   dest.data_ = std::move(croppedData);
+  dest.addDamage(dest.bounds());
 }
 
 const IndexedColorMap &Image::colorMap() const
@@ -406,4 +423,85 @@ BoundingBox Image::bounds() const
 PixelFormat Image::format() const
 {
   return format_;
+}
+
+void Image::setDamageTracking(bool enabled)
+{
+  trackDamage_ = enabled;
+  damage_.clear();
+}
+
+bool Image::damageTracking() const
+{
+  return trackDamage_;
+}
+
+// Beyond this many regions new damage is merged into the cheapest existing region
+static constexpr size_t MaxDamageRegions = 16;
+
+// Pixels a merged region would cover that neither region covers
+static int mergeWaste(const BoundingBox& a, const BoundingBox& b)
+{
+  BoundingBox merged = a;
+  merged.expandToInclude(b);
+  BoundingBox overlap = a;
+  overlap.clipTo(b);
+  return merged.area() - a.area() - b.area() + overlap.area();
+}
+
+void Image::addDamage(BoundingBox region)
+{
+  if (!trackDamage_)
+  {
+    return;
+  }
+
+  region.clipTo(bounds());
+  if (region.empty())
+  {
+    return;
+  }
+
+  // Merge with every region that overlaps or sits close enough that one bigger box
+  // wastes less than half the area of the two, repeating since the merged box may reach others
+  bool merged = true;
+  while (merged)
+  {
+    merged = false;
+    for (auto it = damage_.begin(); it != damage_.end(); ++it)
+    {
+      if (it->intersects(region) || mergeWaste(*it, region) * 2 <= it->area() + region.area())
+      {
+        region.expandToInclude(*it);
+        damage_.erase(it);
+        merged = true;
+        break;
+      }
+    }
+  }
+
+  if (damage_.size() >= MaxDamageRegions)
+  {
+    // Too many separate regions, fold the new one into whichever wastes the least
+    auto best = std::min_element(damage_.begin(), damage_.end(), [&](const BoundingBox& a, const BoundingBox& b)
+    {
+      return mergeWaste(a, region) < mergeWaste(b, region);
+    });
+    region.expandToInclude(*best);
+    damage_.erase(best);
+    addDamage(region);
+    return;
+  }
+
+  damage_.push_back(region);
+}
+
+const std::vector<BoundingBox>& Image::damage() const
+{
+  return damage_;
+}
+
+void Image::clearDamage()
+{
+  damage_.clear();
 }
\ No newline at end of file
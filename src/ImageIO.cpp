@@ -8,11 +8,61 @@
 
 #include <fmt/format.h>
 #include <png.h>
+#include <zlib.h>
 #include <turbojpeg.h>
 #include <TinyEXIF.h>
 
 #include <fstream>
 #include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <climits>
+
+// On-disk layout of a .inky file. All values are little endian.
+#pragma pack(push, 1)
+struct InkyFileHeader
+{
+  static const uint32_t Magic = 0x594B4E49; // "INKY"
+  static const uint16_t CurrentVersion = 1;
+  static const int MaxPaletteSize = 8;
+  static const int MaxPlanes = 4;
+  static const uint32_t PlaneAlignment = 4096;
+
+  struct PaletteEntry
+  {
+    uint8_t colorName;
+    IndexedColor index;
+    RGBAColor rgba;
+  };
+
+  struct PlaneEntry
+  {
+    uint32_t offset;
+    uint32_t length;
+  };
+
+  uint32_t magic = Magic;
+  uint16_t version = CurrentVersion;
+  uint8_t displayVariant = 0;
+  uint8_t planeCount = 0;
+  uint16_t width = 0;
+  uint16_t height = 0;
+  uint8_t paletteSize = 0;
+  uint8_t reserved[3] = {};
+  PaletteEntry palette[MaxPaletteSize] = {};
+  PlaneEntry planes[MaxPlanes] = {};
+};
+#pragma pack(pop)
 
 struct PngReadContext
 {
@@ -68,6 +118,62 @@ struct PngWriteContext
   }
 };
 
+// Concrete encoder parameters behind each EncodeProfile
+struct EncoderParams
+{
+  int zlibLevel;
+  int zlibStrategy;
+  int zlibMemLevel;
+  int pngFilters;
+  int jpegSubsamp;
+  int jpegFlags;
+};
+
+static EncoderParams encoderParams(EncodeProfile profile)
+{
+  switch (profile)
+  {
+    case EncodeProfile::Fastest:
+      // Dithered frames only contain a handful of distinct pixel values, so png
+      // filtering costs time without helping a level 1 deflate much. Level 1 ignores
+      // Z_FILTERED, and Z_RLE can't see the 4 byte repeats in unfiltered RGBA, which
+      // makes dithered frames about three times bigger.
+      return
+      {
+        .zlibLevel = 1,
+        .zlibStrategy = Z_DEFAULT_STRATEGY,
+        .zlibMemLevel = 8,
+        .pngFilters = PNG_FILTER_NONE,
+        .jpegSubsamp = TJSAMP_420,
+        .jpegFlags = TJFLAG_FASTDCT
+      };
+    case EncodeProfile::Smallest:
+      // libjpeg-turbo always generates optimized huffman tables for progressive output
+      return
+      {
+        .zlibLevel = 9,
+        .zlibStrategy = Z_FILTERED,
+        .zlibMemLevel = 9,
+        .pngFilters = PNG_ALL_FILTERS,
+        .jpegSubsamp = TJSAMP_420,
+        .jpegFlags = TJFLAG_ACCURATEDCT | TJFLAG_PROGRESSIVE
+      };
+    case EncodeProfile::Balanced:
+    default:
+      // Z_FILTERED favours literals over short matches, which suits filtered rows. It is
+      // what libpng picks by itself whenever filtering is on.
+      return
+      {
+        .zlibLevel = Z_DEFAULT_COMPRESSION,
+        .zlibStrategy = Z_FILTERED,
+        .zlibMemLevel = 8,
+        .pngFilters = PNG_ALL_FILTERS,
+        .jpegSubsamp = TJSAMP_444,
+        .jpegFlags = TJFLAG_FASTDCT
+      };
+  }
+}
+
 static ImageFormat detectFormat(uint8_t header[8])
 {
   if (header[0] == 0xFF && 
@@ -86,9 +192,16 @@ static ImageFormat detectFormat(uint8_t header[8])
   {
     return ImageFormat::PNG;
   }
+  else if (header[0] == 'q' &&
+           header[1] == 'o' &&
+           header[2] == 'i' &&
+           header[3] == 'f')
+  {
+    return ImageFormat::QOI;
+  }
   else
   {
-    throw std::runtime_error("Unsupported image data! Only png and jpeg are supported.");
+    throw std::runtime_error("Unsupported image data! Only png, jpeg, and qoi are supported.");
   }
 }
 
@@ -105,21 +218,318 @@ static ImageFormat detectFormat(std::filesystem::path imagePath)
   {
     return ImageFormat::JPEG;
   }
+  else if (ext == ".qoi")
+  {
+    return ImageFormat::QOI;
+  }
   else
   {
-    throw std::runtime_error(fmt::format("Unsupported extension '{}'! Only png and jpeg are supported.", ext));
+    throw std::runtime_error(fmt::format("Unsupported extension '{}'! Only png, jpeg, and qoi are supported.", ext));
+  }
+}
+
+static inline uint16_t readBigEndian16(const uint8_t* buf)
+{
+  return (uint16_t)((buf[0] << 8) | buf[1]);
+}
+
+static inline uint32_t readBigEndian32(const uint8_t* buf)
+{
+  return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | (uint32_t)buf[3];
+}
+
+static FlipRotateOperation orientationFromExifSegment(const std::vector<uint8_t>& exifSegment)
+{
+  TinyEXIF::EXIFInfo exif;
+  if (exifSegment.empty() || exif.parseFromEXIFSegment(exifSegment.data(), (unsigned)exifSegment.size()) != TinyEXIF::PARSE_SUCCESS)
+  {
+    return FlipRotateOperation::None;
+  }
+
+  // Orientation is 0 when the exif data doesn't specify one
+  if (exif.Orientation < (uint16_t)FlipRotateOperation::None || exif.Orientation > (uint16_t)FlipRotateOperation::Rotate270)
+  {
+    return FlipRotateOperation::None;
+  }
+  return (FlipRotateOperation)exif.Orientation;
+}
+
+void ImageIO::probeJpeg(std::istream& inputStream, ImageInfo& info, std::vector<uint8_t>* exifSegmentOut)
+{
+  uint8_t buf[8];
+  inputStream.read((char*)buf, 2);
+  if (!inputStream || buf[0] != 0xFF || buf[1] != 0xD8)
+  {
+    throw std::runtime_error("Not a jpeg stream!");
+  }
+
+  info.format = ImageFormat::JPEG;
+  std::vector<uint8_t> exifSegment;
+
+  // Walk the marker segments until the frame header. The exif APP1 segment always comes before it.
+  while (true)
+  {
+    int marker = inputStream.get();
+    if (marker != 0xFF)
+    {
+      throw std::runtime_error("Malformed jpeg header!");
+    }
+    // Markers may be preceded by any number of fill bytes
+    while (marker == 0xFF)
+    {
+      marker = inputStream.get();
+    }
+    if (!inputStream)
+    {
+      throw std::runtime_error("Truncated jpeg header!");
+    }
+
+    // Standalone markers have no length field
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+    {
+      continue;
+    }
+    // Start of scan or end of image without a frame header
+    if (marker == 0xDA || marker == 0xD9)
+    {
+      throw std::runtime_error("Jpeg has no frame header!");
+    }
+
+    inputStream.read((char*)buf, 2);
+    int segmentLength = readBigEndian16(buf) - 2;
+    if (!inputStream || segmentLength < 0)
+    {
+      throw std::runtime_error("Truncated jpeg header!");
+    }
+
+    bool isFrameHeader = (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC);
+    if (isFrameHeader)
+    {
+      // Precision, height, width, component count
+      inputStream.read((char*)buf, 6);
+      if (!inputStream)
+      {
+        throw std::runtime_error("Truncated jpeg header!");
+      }
+      info.height = readBigEndian16(buf + 1);
+      info.width = readBigEndian16(buf + 3);
+      info.channels = buf[5];
+      info.progressive = (marker == 0xC2 || marker == 0xC6 || marker == 0xCA || marker == 0xCE);
+      break;
+    }
+    else if (marker == 0xE1 && exifSegment.empty())
+    {
+      // APP1 is also used for XMP, so only keep it if it's the exif one
+      exifSegment.resize(segmentLength);
+      inputStream.read((char*)exifSegment.data(), segmentLength);
+      if (segmentLength < 6 || memcmp(exifSegment.data(), "Exif\0\0", 6) != 0)
+      {
+        exifSegment.clear();
+      }
+    }
+    else
+    {
+      inputStream.seekg(segmentLength, std::ios::cur);
+    }
+  }
+
+  info.orientation = orientationFromExifSegment(exifSegment);
+  if (exifSegmentOut)
+  {
+    *exifSegmentOut = std::move(exifSegment);
+  }
+}
+
+// Locate the jpeg thumbnail described by IFD1 of an exif segment. Offset is relative to the segment start.
+static bool findExifThumbnail(const std::vector<uint8_t>& exifSegment, size_t& offset, size_t& length)
+{
+  // Skip the "Exif\0\0" prefix to get to the tiff header
+  const size_t tiffStart = 6;
+  if (exifSegment.size() < tiffStart + 8)
+  {
+    return false;
+  }
+  const uint8_t* tiff = exifSegment.data() + tiffStart;
+  const size_t tiffSize = exifSegment.size() - tiffStart;
+  bool littleEndian = (tiff[0] == 'I' && tiff[1] == 'I');
+  if (!littleEndian && !(tiff[0] == 'M' && tiff[1] == 'M'))
+  {
+    return false;
+  }
+
+  auto read16 = [&](size_t pos) -> uint32_t
+  {
+    return littleEndian ? (tiff[pos] | (tiff[pos+1] << 8)) : readBigEndian16(tiff + pos);
+  };
+  auto read32 = [&](size_t pos) -> uint32_t
+  {
+    return littleEndian ? (read16(pos) | (read16(pos+2) << 16)) : readBigEndian32(tiff + pos);
+  };
+
+  // True if bytes bytes from pos are inside the tiff data. Written without adding to pos so
+  // offsets from the file can't wrap around on 32 bit builds.
+  auto fits = [&](size_t pos, size_t bytes)
+  {
+    return bytes <= tiffSize && pos <= tiffSize - bytes;
+  };
+
+  // Hop over IFD0 to the next IFD, which holds the thumbnail
+  size_t ifd0 = read32(4);
+  if (!fits(ifd0, 2))
+  {
+    return false;
+  }
+  size_t ifd0Entries = read16(ifd0);
+  if (!fits(ifd0, 2 + ifd0Entries * 12 + 4))
+  {
+    return false;
+  }
+  size_t ifd1 = read32(ifd0 + 2 + ifd0Entries * 12);
+  if (ifd1 == 0 || !fits(ifd1, 2))
+  {
+    return false;
+  }
+  size_t ifd1Entries = read16(ifd1);
+  if (!fits(ifd1, 2 + ifd1Entries * 12))
+  {
+    return false;
+  }
+
+  uint32_t thumbOffset = 0;
+  uint32_t thumbLength = 0;
+  for (size_t i = 0; i < ifd1Entries; ++i)
+  {
+    size_t entry = ifd1 + 2 + i * 12;
+    uint32_t tag = read16(entry);
+    if (tag == 0x0201) // JPEGInterchangeFormat
+    {
+      thumbOffset = read32(entry + 8);
+    }
+    else if (tag == 0x0202) // JPEGInterchangeFormatLength
+    {
+      thumbLength = read32(entry + 8);
+    }
+  }
+
+  if (thumbOffset == 0 || thumbLength == 0 || !fits(thumbOffset, thumbLength))
+  {
+    return false;
   }
+  offset = tiffStart + thumbOffset;
+  length = thumbLength;
+  return true;
+}
+
+void ImageIO::probePng(std::istream& inputStream, ImageInfo& info)
+{
+  // Signature, then the IHDR chunk which must come first
+  uint8_t buf[8 + 8 + 13];
+  inputStream.read((char*)buf, sizeof(buf));
+  if (!inputStream || memcmp(buf + 12, "IHDR", 4) != 0)
+  {
+    throw std::runtime_error("Malformed png header!");
+  }
+
+  const uint8_t* ihdr = buf + 16;
+  info.format = ImageFormat::PNG;
+  info.width = (int)readBigEndian32(ihdr);
+  info.height = (int)readBigEndian32(ihdr + 4);
+  switch (ihdr[9])
+  {
+    case PNG_COLOR_TYPE_GRAY:       info.channels = 1; break;
+    case PNG_COLOR_TYPE_PALETTE:    info.channels = 1; break;
+    case PNG_COLOR_TYPE_GRAY_ALPHA: info.channels = 2; break;
+    case PNG_COLOR_TYPE_RGB:        info.channels = 3; break;
+    case PNG_COLOR_TYPE_RGBA:       info.channels = 4; break;
+    default:
+      throw std::runtime_error("Unknown png color type!");
+  }
+  info.progressive = (ihdr[12] == PNG_INTERLACE_ADAM7);
 }
 
 void ImageIO::readJpeg(std::istream& inputStream, Image& img, ImageLoadSettings settings)
 {
+  // Read the headers first so exif parsing only has to look at the exif segment
+  ImageInfo info;
+  std::vector<uint8_t> exifSegment;
+  auto start = inputStream.tellg();
+  try
+  {
+    probeJpeg(inputStream, info, &exifSegment);
+  }
+  catch (const std::runtime_error&)
+  {
+    // libjpeg-turbo only warns about e.g. stray bytes between segments, so decode the whole
+    // image as it is rather than failing just because the headers couldn't be walked
+    info = ImageInfo();
+    exifSegment.clear();
+  }
+  inputStream.clear();
+  inputStream.seekg(start);
+
+  // The minimum size is given for the rectified image, so swap it if the image is stored sideways
+  int minWidth = settings.minWidth;
+  int minHeight = settings.minHeight;
+  if (settings.autoRotate && info.orientation >= FlipRotateOperation::Rotate90Mirror)
+  {
+    std::swap(minWidth, minHeight);
+  }
+
+  tjhandle _jpegDecompressor = tjInitDecompress();
+  int jpegSubsamp;
+
+  // Decode the exif thumbnail if it's big enough, which is much cheaper than even a scaled decode
+  if (settings.allowThumbnail && (minWidth > 0 || minHeight > 0))
+  {
+    size_t thumbOffset, thumbLength;
+    int thumbWidth, thumbHeight;
+    if (findExifThumbnail(exifSegment, thumbOffset, thumbLength) &&
+        tjDecompressHeader2(_jpegDecompressor, exifSegment.data() + thumbOffset, thumbLength, &thumbWidth, &thumbHeight, &jpegSubsamp) == 0 &&
+        thumbWidth >= minWidth && thumbHeight >= minHeight)
+    {
+      img.width_ = thumbWidth;
+      img.height_ = thumbHeight;
+      img.format_ = PixelFormat::RGBA;
+      img.data_.resize(img.width_ * img.height_ * 4);
+      if (tjDecompress2(_jpegDecompressor, exifSegment.data() + thumbOffset, thumbLength, img.data_.data(), img.width_, 0 /*pitch*/, img.height_, TJPF_RGBA, TJFLAG_FASTDCT) == 0)
+      {
+        tjDestroy(_jpegDecompressor);
+        if (settings.autoRotate)
+        {
+          img.rotateFlip(info.orientation);
+        }
+        return;
+      }
+    }
+  }
+
   std::vector<char> compressedImage;
   compressedImage.assign(std::istreambuf_iterator<char>(inputStream), std::istreambuf_iterator<char>());
 
-  int jpegSubsamp;
-  tjhandle _jpegDecompressor = tjInitDecompress();
   // const cast to deal with C api
   tjDecompressHeader2(_jpegDecompressor, (uint8_t*)compressedImage.data(), compressedImage.size(), &img.width_, &img.height_, &jpegSubsamp);
+
+  // Pick the smallest DCT scaling factor that still covers the minimum size
+  if (minWidth > 0 || minHeight > 0)
+  {
+    int factorCount = 0;
+    tjscalingfactor* factors = tjGetScalingFactors(&factorCount);
+    int bestWidth = img.width_;
+    int bestHeight = img.height_;
+    for (int i = 0; i < factorCount; ++i)
+    {
+      int scaledWidth = TJSCALED(img.width_, factors[i]);
+      int scaledHeight = TJSCALED(img.height_, factors[i]);
+      if (scaledWidth >= minWidth && scaledHeight >= minHeight && scaledWidth < bestWidth)
+      {
+        bestWidth = scaledWidth;
+        bestHeight = scaledHeight;
+      }
+    }
+    img.width_ = bestWidth;
+    img.height_ = bestHeight;
+  }
+
   img.format_ = PixelFormat::RGBA;
   img.data_.resize(img.width_ * img.height_ * 4);
   tjDecompress2(_jpegDecompressor, (uint8_t*)compressedImage.data(), compressedImage.size(), img.data_.data(), img.width_, 0 /*pitch*/, img.height_, TJPF_RGBA, TJFLAG_FASTDCT);
@@ -127,8 +537,7 @@ void ImageIO::readJpeg(std::istream& inputStream, Image& img, ImageLoadSettings
 
   if (settings.autoRotate)
   {
-    TinyEXIF::EXIFInfo exif((uint8_t*)compressedImage.data(), compressedImage.size());
-    img.rotateFlip((FlipRotateOperation)exif.Orientation);
+    img.rotateFlip(info.orientation);
   }
 }
 
@@ -137,11 +546,12 @@ void ImageIO::writeJpeg(std::ostream& outputStream, const Image& img, ImageSaveS
   long unsigned int jpegSize = 0;
   uint8_t *compressedImage = NULL; //!< Memory is allocated by tjCompress2 if _jpegSize == 0
 
+  EncoderParams params = encoderParams(settings.encodeProfile);
   tjhandle jpegCompressor = tjInitCompress();
 
   tjCompress2(jpegCompressor, img.data(), img.width(), 0, img.height(), TJPF_RGBA,
-              &compressedImage, &jpegSize, TJSAMP_444, settings.jpegQuality,
-              TJFLAG_FASTDCT);
+              &compressedImage, &jpegSize, params.jpegSubsamp, settings.jpegQuality,
+              params.jpegFlags);
 
   tjDestroy(jpegCompressor);
 
@@ -217,7 +627,7 @@ void ImageIO::readPng(std::istream& inputStream, Image& img, ImageLoadSettings /
   }
 }
 
-void ImageIO::writePng(std::ostream& outputStream, const Image& img, ImageSaveSettings /*settings*/)
+void ImageIO::writePng(std::ostream& outputStream, const Image& img, ImageSaveSettings settings)
 {
   PngWriteContext ctx;
   if (!ctx.ok())
@@ -230,7 +640,13 @@ void ImageIO::writePng(std::ostream& outputStream, const Image& img, ImageSaveSe
                 PNG_INTERLACE_NONE,
                 PNG_COMPRESSION_TYPE_DEFAULT,
                 PNG_FILTER_TYPE_DEFAULT);
-  // png_set_compression_level(p, 1);
+
+  EncoderParams params = encoderParams(settings.encodeProfile);
+  png_set_filter(ctx.structp, PNG_FILTER_TYPE_BASE, params.pngFilters);
+  png_set_compression_level(ctx.structp, params.zlibLevel);
+  png_set_compression_strategy(ctx.structp, params.zlibStrategy);
+  png_set_compression_mem_level(ctx.structp, params.zlibMemLevel);
+
   std::vector<const uint8_t*> rows(img.height_);
   for (size_t y = 0; y < img.height_; ++y)
   {
@@ -246,6 +662,598 @@ void ImageIO::writePng(std::ostream& outputStream, const Image& img, ImageSaveSe
   png_write_png(ctx.structp, ctx.infop, PNG_TRANSFORM_IDENTITY, NULL);
 }
 
+// Worker threads shared by every parallel png encode. They are started by the first encode
+// that wants them and kept until exit, so later encodes don't pay to spawn threads.
+class EncodeWorkers
+{
+public:
+  static EncodeWorkers& Shared()
+  {
+    static EncodeWorkers workers;
+    return workers;
+  }
+
+  ~EncodeWorkers()
+  {
+    {
+      std::lock_guard lock(mutex_);
+      stop_ = true;
+    }
+    tasksChanged_.notify_all();
+    for (auto& thread : threads_)
+    {
+      thread.join();
+    }
+  }
+
+  // Run fn(i) for every i in [0, count) on the calling thread plus up to threadCount - 1 workers
+  template <typename Fn>
+  void parallelFor(int count, int threadCount, Fn fn)
+  {
+    if (count <= 0)
+    {
+      return;
+    }
+    threadCount = std::clamp(threadCount, 1, count);
+
+    std::atomic<int> next {0};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto work = [&]()
+    {
+      for (int i = next++; i < count; i = next++)
+      {
+        try
+        {
+          fn(i);
+        }
+        catch (...)
+        {
+          std::lock_guard lock(errorMutex);
+          error = std::current_exception();
+        }
+      }
+    };
+
+    // Helpers capture this frame by reference, so wait for every one to finish, even
+    // one that only starts after the caller has done all the work
+    int helpers = threadCount - 1;
+    std::mutex doneMutex;
+    std::condition_variable doneChanged;
+    int helpersDone = 0;
+    {
+      std::lock_guard lock(mutex_);
+      while ((int)threads_.size() < helpers)
+      {
+        threads_.emplace_back(&EncodeWorkers::run, this);
+      }
+      for (int t = 0; t < helpers; ++t)
+      {
+        tasks_.push_back([&]()
+        {
+          work();
+          std::lock_guard doneLock(doneMutex);
+          ++helpersDone;
+          doneChanged.notify_one();
+        });
+      }
+    }
+    tasksChanged_.notify_all();
+
+    work();
+    {
+      std::unique_lock lock(doneMutex);
+      doneChanged.wait(lock, [&] { return helpersDone == helpers; });
+    }
+
+    if (error)
+    {
+      std::rethrow_exception(error);
+    }
+  }
+
+private:
+  EncodeWorkers() = default;
+
+  void run()
+  {
+    std::unique_lock lock(mutex_);
+    while (true)
+    {
+      tasksChanged_.wait(lock, [&] { return stop_ || !tasks_.empty(); });
+      if (stop_)
+      {
+        break;
+      }
+      auto task = std::move(tasks_.front());
+      tasks_.pop_front();
+      lock.unlock();
+      task();
+      lock.lock();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable tasksChanged_;
+  std::deque<std::function<void()>> tasks_;
+  std::vector<std::thread> threads_;
+  bool stop_ = false;
+};
+
+static inline void writeBigEndian32(uint32_t val, uint8_t* buf)
+{
+  buf[0] = (uint8_t)(val >> 24);
+  buf[1] = (uint8_t)(val >> 16);
+  buf[2] = (uint8_t)(val >> 8);
+  buf[3] = (uint8_t)val;
+}
+
+static void writePngChunk(std::ostream& outputStream, const char* type, const uint8_t* data, size_t len)
+{
+  uint8_t header[8];
+  writeBigEndian32((uint32_t)len, header);
+  memcpy(header + 4, type, 4);
+  uLong crc = crc32(0, header + 4, 4);
+  if (len > 0)
+  {
+    crc = crc32(crc, data, (uInt)len);
+  }
+  uint8_t crcBytes[4];
+  writeBigEndian32((uint32_t)crc, crcBytes);
+  outputStream.write((char*)header, 8);
+  outputStream.write((char*)data, len);
+  outputStream.write((char*)crcBytes, 4);
+}
+
+static inline uint8_t paethPredictor(int a, int b, int c)
+{
+  int p = a + b - c;
+  int pa = std::abs(p - a);
+  int pb = std::abs(p - b);
+  int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc) return (uint8_t)a;
+  if (pb <= pc) return (uint8_t)b;
+  return (uint8_t)c;
+}
+
+// Filter a single row with the given png filter type, writing the type byte followed by the filtered data
+static void filterPngRow(int filterType, const uint8_t* row, const uint8_t* prev, size_t rowBytes, size_t bpp, uint8_t* out)
+{
+  *out++ = (uint8_t)filterType;
+  for (size_t i = 0; i < rowBytes; ++i)
+  {
+    int left = (i >= bpp) ? row[i - bpp] : 0;
+    int up = prev ? prev[i] : 0;
+    int upLeft = (prev && i >= bpp) ? prev[i - bpp] : 0;
+    switch (filterType)
+    {
+      case PNG_FILTER_VALUE_SUB:   out[i] = (uint8_t)(row[i] - left); break;
+      case PNG_FILTER_VALUE_UP:    out[i] = (uint8_t)(row[i] - up); break;
+      case PNG_FILTER_VALUE_AVG:   out[i] = (uint8_t)(row[i] - ((left + up) >> 1)); break;
+      case PNG_FILTER_VALUE_PAETH: out[i] = (uint8_t)(row[i] - paethPredictor(left, up, upLeft)); break;
+      default:                     out[i] = row[i]; break;
+    }
+  }
+}
+
+// Filter a row using the allowed filter with the lowest sum of absolute differences,
+// which is the same heuristic libpng uses for adaptive filtering
+static void filterPngRowAdaptive(int allowedFilters, const uint8_t* row, const uint8_t* prev, size_t rowBytes, size_t bpp, uint8_t* out, std::vector<uint8_t>& scratch)
+{
+  static const std::pair<int,int> filters[] 
+  {
+    {PNG_FILTER_NONE, PNG_FILTER_VALUE_NONE},
+    {PNG_FILTER_SUB, PNG_FILTER_VALUE_SUB},
+    {PNG_FILTER_UP, PNG_FILTER_VALUE_UP},
+    {PNG_FILTER_AVG, PNG_FILTER_VALUE_AVG},
+    {PNG_FILTER_PAETH, PNG_FILTER_VALUE_PAETH}
+  };
+
+  scratch.resize(rowBytes + 1);
+  uint64_t bestSum = UINT64_MAX;
+  for (const auto& [flag, filterType] : filters)
+  {
+    if ((allowedFilters & flag) == 0)
+    {
+      continue;
+    }
+    filterPngRow(filterType, row, prev, rowBytes, bpp, scratch.data());
+    uint64_t sum = 0;
+    for (size_t i = 1; i <= rowBytes; ++i)
+    {
+      sum += std::abs((int8_t)scratch[i]);
+    }
+    if (sum < bestSum)
+    {
+      bestSum = sum;
+      memcpy(out, scratch.data(), rowBytes + 1);
+    }
+  }
+
+  if (bestSum == UINT64_MAX)
+  {
+    filterPngRow(PNG_FILTER_VALUE_NONE, row, prev, rowBytes, bpp, out);
+  }
+}
+
+void ImageIO::writePngParallel(std::ostream& outputStream, const Image& img, ImageSaveSettings settings)
+{
+  // Blocks of about 128k of raw data keep the ratio loss from splitting the stream small
+  const size_t targetBlockBytes = 128 * 1024;
+  const uInt windowSize = 32768;
+
+  if (img.width_ < 1 || img.height_ < 1)
+  {
+    throw std::runtime_error("Cannot save zero-dimension image!");
+  }
+
+  EncoderParams params = encoderParams(settings.encodeProfile);
+  int threadCount = (settings.pngThreads > 0) ? settings.pngThreads : (int)std::thread::hardware_concurrency();
+
+  const size_t bpp = 4;
+  const size_t rowBytes = (size_t)img.width_ * bpp;
+  const size_t filteredRowBytes = rowBytes + 1;
+  const int rowsPerBlock = std::max(1, (int)(targetBlockBytes / filteredRowBytes));
+  const int blockCount = (img.height_ + rowsPerBlock - 1) / rowsPerBlock;
+
+  // Filter all the rows. Filters only look at the unfiltered previous row,
+  // so every row is independent of the others.
+  std::vector<uint8_t> filtered(filteredRowBytes * img.height_);
+  EncodeWorkers::Shared().parallelFor(blockCount, threadCount, [&](int block)
+  {
+    std::vector<uint8_t> scratch;
+    int endRow = std::min(img.height_, (block + 1) * rowsPerBlock);
+    for (int y = block * rowsPerBlock; y < endRow; ++y)
+    {
+      const uint8_t* row = img.data_.data() + y * rowBytes;
+      const uint8_t* prev = (y > 0) ? row - rowBytes : nullptr;
+      filterPngRowAdaptive(params.pngFilters, row, prev, rowBytes, bpp, filtered.data() + y * filteredRowBytes, scratch);
+    }
+  });
+
+  // Deflate each block as a raw stream primed with the previous block's tail. Every block but the
+  // last ends on a sync flush so the blocks are byte aligned and can simply be concatenated.
+  std::vector<std::vector<uint8_t>> compressed(blockCount);
+  std::vector<uLong> checksums(blockCount);
+  EncodeWorkers::Shared().parallelFor(blockCount, threadCount, [&](int block)
+  {
+    size_t start = (size_t)block * rowsPerBlock * filteredRowBytes;
+    size_t end = std::min(filtered.size(), (size_t)(block + 1) * rowsPerBlock * filteredRowBytes);
+    bool last = (block == blockCount - 1);
+
+    z_stream strm {};
+    if (deflateInit2(&strm, params.zlibLevel, Z_DEFLATED, -15, params.zlibMemLevel, params.zlibStrategy) != Z_OK)
+    {
+      throw std::runtime_error("Could not create deflate stream!");
+    }
+
+    if (start > 0)
+    {
+      uInt dictLen = (uInt)std::min<size_t>(windowSize, start);
+      deflateSetDictionary(&strm, filtered.data() + start - dictLen, dictLen);
+    }
+
+    auto& out = compressed[block];
+    out.resize(deflateBound(&strm, (uLong)(end - start)) + 16);
+    strm.next_in = filtered.data() + start;
+    strm.avail_in = (uInt)(end - start);
+    strm.next_out = out.data();
+    strm.avail_out = (uInt)out.size();
+    int ret = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+    out.resize(out.size() - strm.avail_out);
+    deflateEnd(&strm);
+
+    if (ret != (last ? Z_STREAM_END : Z_OK) || strm.avail_in != 0)
+    {
+      throw std::runtime_error("Failed to deflate png data!");
+    }
+
+    checksums[block] = adler32(adler32(0, nullptr, 0), filtered.data() + start, (uInt)(end - start));
+  });
+
+  // Stitch the zlib header, the raw deflate blocks, and the combined adler-32 together
+  uLong adler = checksums[0];
+  for (int block = 1; block < blockCount; ++block)
+  {
+    size_t len = std::min(filtered.size() - (size_t)block * rowsPerBlock * filteredRowBytes, (size_t)rowsPerBlock * filteredRowBytes);
+    adler = adler32_combine(adler, checksums[block], (z_off_t)len);
+  }
+
+  int levelFlag = (params.zlibLevel == 1) ? 0 : (params.zlibLevel >= 2 && params.zlibLevel <= 5) ? 1 : (params.zlibLevel >= 7) ? 3 : 2;
+  uint8_t zlibHeader[2] = {0x78, (uint8_t)(levelFlag << 6)};
+  zlibHeader[1] |= (uint8_t)(31 - ((zlibHeader[0] << 8) | zlibHeader[1]) % 31);
+  uint8_t zlibTrailer[4];
+  writeBigEndian32((uint32_t)adler, zlibTrailer);
+
+  compressed.front().insert(compressed.front().begin(), zlibHeader, zlibHeader + 2);
+  compressed.back().insert(compressed.back().end(), zlibTrailer, zlibTrailer + 4);
+
+  // Write out the png
+  static const uint8_t signature[8] {0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A};
+  outputStream.write((char*)signature, 8);
+
+  uint8_t ihdr[13];
+  writeBigEndian32((uint32_t)img.width_, ihdr);
+  writeBigEndian32((uint32_t)img.height_, ihdr + 4);
+  ihdr[8] = 8;                     // bit depth
+  ihdr[9] = PNG_COLOR_TYPE_RGBA;
+  ihdr[10] = PNG_COMPRESSION_TYPE_BASE;
+  ihdr[11] = PNG_FILTER_TYPE_BASE;
+  ihdr[12] = PNG_INTERLACE_NONE;
+  writePngChunk(outputStream, "IHDR", ihdr, sizeof(ihdr));
+
+  for (const auto& block : compressed)
+  {
+    writePngChunk(outputStream, "IDAT", block.data(), block.size());
+  }
+
+  writePngChunk(outputStream, "IEND", nullptr, 0);
+}
+
+// QOI - The "Quite OK Image Format", see https://qoiformat.org/qoi-specification.pdf
+static const uint8_t QoiOpIndex = 0x00;
+static const uint8_t QoiOpDiff = 0x40;
+static const uint8_t QoiOpLuma = 0x80;
+static const uint8_t QoiOpRun = 0xC0;
+static const uint8_t QoiOpRgb = 0xFE;
+static const uint8_t QoiOpRgba = 0xFF;
+static const uint8_t QoiMask2 = 0xC0;
+static const size_t QoiHeaderSize = 14;
+static const uint8_t QoiEndMarker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+// Largest image the decoder will allocate for. Caches hold display sized frames, so this is
+// far more than they need while keeping a corrupt header from asking for gigabytes.
+static const uint64_t QoiMaxPixels = 8192 * 8192;
+// A run chunk is one byte for up to 62 pixels, so valid data can't describe more than this
+static const uint64_t QoiMaxPixelsPerByte = 62;
+
+static inline int qoiHash(const RGBAColor& c)
+{
+  return (c.R * 3 + c.G * 5 + c.B * 7 + c.A * 11) % 64;
+}
+
+void ImageIO::probeQoi(std::istream& inputStream, ImageInfo& info)
+{
+  uint8_t header[QoiHeaderSize];
+  inputStream.read((char*)header, QoiHeaderSize);
+  if (!inputStream || memcmp(header, "qoif", 4) != 0)
+  {
+    throw std::runtime_error("Malformed qoi header!");
+  }
+  info.format = ImageFormat::QOI;
+  info.width = (int)readBigEndian32(header + 4);
+  info.height = (int)readBigEndian32(header + 8);
+  info.channels = header[12];
+}
+
+void ImageIO::decodeQoi(const uint8_t* data, size_t len, Image& img)
+{
+  if (len < QoiHeaderSize + sizeof(QoiEndMarker) || memcmp(data, "qoif", 4) != 0)
+  {
+    throw std::runtime_error("Malformed qoi data!");
+  }
+
+  // Check the size before allocating anything, the header may be corrupt or crafted
+  uint64_t width = readBigEndian32(data + 4);
+  uint64_t height = readBigEndian32(data + 8);
+  uint64_t chunkBytes = len - QoiHeaderSize - sizeof(QoiEndMarker);
+  if (width == 0 || height == 0 || width > INT_MAX || height > INT_MAX ||
+      width * height > QoiMaxPixels || width * height > chunkBytes * QoiMaxPixelsPerByte)
+  {
+    throw std::runtime_error(fmt::format("Qoi image size {}x{} is empty, too large or doesn't match its data!", width, height));
+  }
+
+  img.width_ = (int)width;
+  img.height_ = (int)height;
+  img.format_ = PixelFormat::RGBA;
+  img.data_.resize((size_t)img.width_ * img.height_ * 4);
+
+  RGBAColor index[64] = {};
+  RGBAColor px {0, 0, 0, 255};
+  RGBAColor* out = (RGBAColor*)img.data_.data();
+  size_t pixelCount = (size_t)img.width_ * img.height_;
+  size_t pos = QoiHeaderSize;
+  size_t chunksEnd = len - sizeof(QoiEndMarker);
+  int run = 0;
+
+  for (size_t i = 0; i < pixelCount; ++i)
+  {
+    if (run > 0)
+    {
+      --run;
+    }
+    else if (pos < chunksEnd)
+    {
+      uint8_t b1 = data[pos++];
+      if (b1 == QoiOpRgb)
+      {
+        px.R = data[pos];
+        px.G = data[pos+1];
+        px.B = data[pos+2];
+        pos += 3;
+      }
+      else if (b1 == QoiOpRgba)
+      {
+        px.R = data[pos];
+        px.G = data[pos+1];
+        px.B = data[pos+2];
+        px.A = data[pos+3];
+        pos += 4;
+      }
+      else if ((b1 & QoiMask2) == QoiOpIndex)
+      {
+        px = index[b1];
+      }
+      else if ((b1 & QoiMask2) == QoiOpDiff)
+      {
+        px.R += ((b1 >> 4) & 0x03) - 2;
+        px.G += ((b1 >> 2) & 0x03) - 2;
+        px.B += (b1 & 0x03) - 2;
+      }
+      else if ((b1 & QoiMask2) == QoiOpLuma)
+      {
+        uint8_t b2 = data[pos++];
+        int vg = (b1 & 0x3F) - 32;
+        px.R += vg - 8 + ((b2 >> 4) & 0x0F);
+        px.G += vg;
+        px.B += vg - 8 + (b2 & 0x0F);
+      }
+      else // QoiOpRun
+      {
+        run = (b1 & 0x3F);
+      }
+      index[qoiHash(px)] = px;
+    }
+    out[i] = px;
+  }
+}
+
+void ImageIO::encodeQoi(const Image& img, std::string& str)
+{
+  size_t pixelCount = (size_t)img.width_ * img.height_;
+  str.resize(QoiHeaderSize + pixelCount * 5 + sizeof(QoiEndMarker));
+  uint8_t* bytes = (uint8_t*)str.data();
+
+  memcpy(bytes, "qoif", 4);
+  writeBigEndian32((uint32_t)img.width_, bytes + 4);
+  writeBigEndian32((uint32_t)img.height_, bytes + 8);
+  bytes[12] = 4; // channels
+  bytes[13] = 0; // sRGB with linear alpha
+  size_t pos = QoiHeaderSize;
+
+  RGBAColor index[64] = {};
+  RGBAColor prev {0, 0, 0, 255};
+  const RGBAColor* pixels = (const RGBAColor*)img.data_.data();
+  int run = 0;
+
+  for (size_t i = 0; i < pixelCount; ++i)
+  {
+    const RGBAColor& px = pixels[i];
+    if (memcmp(&px, &prev, sizeof(RGBAColor)) == 0)
+    {
+      ++run;
+      if (run == 62 || i == pixelCount - 1)
+      {
+        bytes[pos++] = QoiOpRun | (run - 1);
+        run = 0;
+      }
+      continue;
+    }
+
+    if (run > 0)
+    {
+      bytes[pos++] = QoiOpRun | (run - 1);
+      run = 0;
+    }
+
+    int hash = qoiHash(px);
+    if (memcmp(&index[hash], &px, sizeof(RGBAColor)) == 0)
+    {
+      bytes[pos++] = QoiOpIndex | hash;
+    }
+    else
+    {
+      index[hash] = px;
+      if (px.A == prev.A)
+      {
+        int8_t vr = (int8_t)(px.R - prev.R);
+        int8_t vg = (int8_t)(px.G - prev.G);
+        int8_t vb = (int8_t)(px.B - prev.B);
+        int8_t vgr = vr - vg;
+        int8_t vgb = vb - vg;
+
+        if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+        {
+          bytes[pos++] = QoiOpDiff | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2);
+        }
+        else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8)
+        {
+          bytes[pos++] = QoiOpLuma | (vg + 32);
+          bytes[pos++] = ((vgr + 8) << 4) | (vgb + 8);
+        }
+        else
+        {
+          bytes[pos++] = QoiOpRgb;
+          bytes[pos++] = px.R;
+          bytes[pos++] = px.G;
+          bytes[pos++] = px.B;
+        }
+      }
+      else
+      {
+        bytes[pos++] = QoiOpRgba;
+        bytes[pos++] = px.R;
+        bytes[pos++] = px.G;
+        bytes[pos++] = px.B;
+        bytes[pos++] = px.A;
+      }
+    }
+    prev = px;
+  }
+
+  memcpy(bytes + pos, QoiEndMarker, sizeof(QoiEndMarker));
+  pos += sizeof(QoiEndMarker);
+  str.resize(pos);
+}
+
+void ImageIO::readQoi(std::istream& inputStream, Image& img, ImageLoadSettings /*settings*/)
+{
+  std::vector<char> compressedImage;
+  compressedImage.assign(std::istreambuf_iterator<char>(inputStream), std::istreambuf_iterator<char>());
+  decodeQoi((const uint8_t*)compressedImage.data(), compressedImage.size(), img);
+}
+
+void ImageIO::writeQoi(std::ostream& outputStream, const Image& img, ImageSaveSettings /*settings*/)
+{
+  std::string compressedImage;
+  encodeQoi(img, compressedImage);
+  outputStream.write(compressedImage.data(), compressedImage.size());
+}
+
+ImageInfo ImageIO::ProbeFromStream(std::istream& stream)
+{
+  // Detect the file type
+  uint8_t header[8];
+  stream.read((char*)header, 8);
+  auto format = detectFormat(header);
+
+  // Rewind the input stream...
+  stream.clear();
+  stream.seekg(0, std::ios::beg);
+
+  ImageInfo info;
+
+  if (format == ImageFormat::JPEG)
+  {
+    probeJpeg(stream, info);
+  }
+  else if (format == ImageFormat::PNG)
+  {
+    probePng(stream, info);
+  }
+  else if (format == ImageFormat::QOI)
+  {
+    probeQoi(stream, info);
+  }
+  else
+  {
+    throw std::runtime_error("Unsupported image data!");
+  }
+
+  return info;
+}
+
+ImageInfo ImageIO::ProbeFromBuffer(const std::string& str)
+{
+  std::istringstream inputStream(str);
+  return ProbeFromStream(inputStream);
+}
+
+ImageInfo ImageIO::ProbeFromFile(std::filesystem::path imagePath)
+{
+  std::ifstream inputStream(imagePath, std::ios::binary);
+  return ProbeFromStream(inputStream);
+}
+
 Image ImageIO::LoadFromStream(std::istream& stream, ImageLoadSettings settings)
 {
   // Detect the file type
@@ -267,6 +1275,10 @@ Image ImageIO::LoadFromStream(std::istream& stream, ImageLoadSettings settings)
   {
     readPng(stream, img, settings);
   }
+  else if (format == ImageFormat::QOI)
+  {
+    readQoi(stream, img, settings);
+  }
   else
   {
     throw std::runtime_error("Unsupported image data!");
@@ -277,6 +1289,14 @@ Image ImageIO::LoadFromStream(std::istream& stream, ImageLoadSettings settings)
 
 Image ImageIO::LoadFromBuffer(const std::string& str, ImageLoadSettings settings)
 {
+  // QOI decodes straight from the buffer, skipping the stream copy
+  if (str.size() >= 8 && detectFormat((uint8_t*)str.data()) == ImageFormat::QOI)
+  {
+    Image img;
+    decodeQoi((const uint8_t*)str.data(), str.size(), img);
+    return img;
+  }
+
   std::istringstream inputStream(str);
   return LoadFromStream(inputStream, settings);
 }
@@ -315,10 +1335,18 @@ void ImageIO::SaveToStream(const Image& image, std::ostream& stream, ImageSaveSe
   {
     writeJpeg(stream, *imgToSave, settings);
   }
+  else if (settings.saveFormat == ImageFormat::PNG && settings.pngThreads != 1)
+  {
+    writePngParallel(stream, *imgToSave, settings);
+  }
   else if (settings.saveFormat == ImageFormat::PNG)
   {
     writePng(stream, *imgToSave, settings);
   }
+  else if (settings.saveFormat == ImageFormat::QOI)
+  {
+    writeQoi(stream, *imgToSave, settings);
+  }
   else
   {
     throw std::runtime_error("Unsupported image data!");
@@ -327,6 +1355,13 @@ void ImageIO::SaveToStream(const Image& image, std::ostream& stream, ImageSaveSe
 
 void ImageIO::SaveToBuffer(const Image& image, std::string& str, ImageSaveSettings settings)
 {
+  // QOI encodes straight into the buffer, skipping the stream copy
+  if (settings.saveFormat == ImageFormat::QOI && image.format() == PixelFormat::RGBA && image.width() > 0 && image.height() > 0)
+  {
+    encodeQoi(image, str);
+    return;
+  }
+
   std::ostringstream outputStream;
   SaveToStream(image, outputStream, settings);
   str = outputStream.str();
@@ -342,3 +1377,128 @@ void ImageIO::SaveToFile(std::filesystem::path imagePath, const Image& image, Im
   SaveToStream(image, outputStream, settings);
   outputStream.close();
 }
+
+void ImageIO::SavePackedFrame(std::filesystem::path framePath, const PackedFrame& frame)
+{
+  const auto& indexedColors = frame.colorMap.indexedColors();
+  const auto& namedColors = frame.colorMap.namedColors();
+  if (frame.planes.size() > InkyFileHeader::MaxPlanes || indexedColors.size() > InkyFileHeader::MaxPaletteSize)
+  {
+    throw std::runtime_error("Packed frame has too many planes or colors to save!");
+  }
+
+  InkyFileHeader header;
+  header.displayVariant = frame.displayVariant;
+  header.planeCount = (uint8_t)frame.planes.size();
+  header.width = (uint16_t)frame.width;
+  header.height = (uint16_t)frame.height;
+  header.paletteSize = (uint8_t)indexedColors.size();
+  for (int i = 0; i < header.paletteSize; ++i)
+  {
+    header.palette[i] = 
+    {
+      .colorName = (uint8_t)namedColors[i],
+      .index = indexedColors[i],
+      .rgba = frame.colorMap.toRGBAColor(indexedColors[i])
+    };
+  }
+
+  // Place each plane on its own page
+  auto alignUp = [](uint32_t val) { return (val + InkyFileHeader::PlaneAlignment - 1) / InkyFileHeader::PlaneAlignment * InkyFileHeader::PlaneAlignment; };
+  uint32_t offset = alignUp(sizeof(InkyFileHeader));
+  for (int i = 0; i < header.planeCount; ++i)
+  {
+    header.planes[i] = {offset, (uint32_t)frame.planes[i].size()};
+    offset = alignUp(offset + (uint32_t)frame.planes[i].size());
+  }
+
+  // Write next to the target and rename over it, so a reader that has the old file mapped
+  // never sees it truncated or half rewritten
+  std::filesystem::path tempPath = framePath;
+  tempPath += fmt::format(".{}.tmp", getpid());
+  std::ofstream outputStream(tempPath, std::ios::binary | std::ios::trunc);
+  outputStream.write((const char*)&header, sizeof(header));
+  for (int i = 0; i < header.planeCount; ++i)
+  {
+    outputStream.seekp(header.planes[i].offset);
+    outputStream.write((const char*)frame.planes[i].data(), frame.planes[i].size());
+  }
+  // Pad the file out to a whole page
+  if ((uint32_t)outputStream.tellp() < offset)
+  {
+    outputStream.seekp(offset - 1);
+    outputStream.put(0);
+  }
+  outputStream.close();
+  std::error_code error;
+  if (outputStream)
+  {
+    std::filesystem::rename(tempPath, framePath, error);
+  }
+  if (!outputStream || error)
+  {
+    std::filesystem::remove(tempPath, error);
+    throw std::runtime_error(fmt::format("Failed to write packed frame '{}'!", framePath.string()));
+  }
+}
+
+PackedFrame ImageIO::MapPackedFrame(std::filesystem::path framePath)
+{
+  int fd = open(framePath.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    throw std::runtime_error(fmt::format("Could not open packed frame '{}'!", framePath.string()));
+  }
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t)sizeof(InkyFileHeader))
+  {
+    close(fd);
+    throw std::runtime_error(fmt::format("'{}' is not a packed frame!", framePath.string()));
+  }
+
+  size_t mappedSize = (size_t)fileStat.st_size;
+  void* mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+  {
+    throw std::runtime_error(fmt::format("Could not map packed frame '{}'!", framePath.string()));
+  }
+
+  PackedFrame frame;
+  frame.storage = std::shared_ptr<const void>(mapping, [mappedSize](const void* ptr)
+  {
+    munmap(const_cast<void*>(ptr), mappedSize);
+  });
+
+  const uint8_t* base = (const uint8_t*)mapping;
+  const InkyFileHeader& header = *(const InkyFileHeader*)base;
+  if (header.magic != InkyFileHeader::Magic || header.version != InkyFileHeader::CurrentVersion ||
+      header.planeCount > InkyFileHeader::MaxPlanes || header.paletteSize > InkyFileHeader::MaxPaletteSize)
+  {
+    throw std::runtime_error(fmt::format("'{}' is not a supported packed frame!", framePath.string()));
+  }
+
+  frame.displayVariant = header.displayVariant;
+  frame.width = header.width;
+  frame.height = header.height;
+
+  std::vector<std::tuple<ColorName,IndexedColor,RGBAColor>> palette;
+  for (int i = 0; i < header.paletteSize; ++i)
+  {
+    palette.push_back({(ColorName)header.palette[i].colorName, header.palette[i].index, header.palette[i].rgba});
+  }
+  frame.colorMap = IndexedColorMap(palette);
+
+  for (int i = 0; i < header.planeCount; ++i)
+  {
+    const auto& plane = header.planes[i];
+    if ((size_t)plane.offset + plane.length > mappedSize)
+    {
+      throw std::runtime_error(fmt::format("Packed frame '{}' is truncated!", framePath.string()));
+    }
+    frame.planes.emplace_back(base + plane.offset, plane.length);
+  }
+
+  return frame;
+}
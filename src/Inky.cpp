@@ -2,15 +2,26 @@
 #include "I2CDevice.hpp"
 #include "SPIDevice.hpp"
 #include "ImageIO.hpp"
+#include "Dither.hpp"
+#include "Hash.hpp"
+#include "PackBits.hpp"
 
 #include <gpio-cpp/gpio.hpp>
 #include <fmt/format.h>
 
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <span>
 #include <chrono>
 #include <thread>
 #include <algorithm>
 #include <stdexcept>
+#include <array>
+#include <map>
+#include <fstream>
+#include <filesystem>
+#include <random>
 
 //#define DEBUG_SPI
 #ifdef DEBUG_SPI
@@ -22,6 +33,12 @@ using namespace magic_enum::ostream_operators;
 static const uint8_t InkyI2CDevice = 0x50;
 static const std::string InkySPIDevice = "/dev/spidev0.0";
 static const std::string InkyGPIODevice = "/dev/gpiochip0";
+// SPI clocks saved by calibrateSpiClock and setSpiClock, one line per unit
+static const std::string InkySPIClockFile = "/var/lib/inky-cpp/spi_clock.txt";
+// Rates calibrateSpiClock tries in order, stopping at the first that fails
+static const uint32_t SPIClockSteps[] = {2000000, 4000000, 8000000, 10000000, 12000000, 16000000, 20000000, 25000000, 32000000, 40000000, 50000000};
+// Percentage of the fastest good rate to run at
+static const uint32_t SPIClockMarginPercent = 75;
 
 enum class InkyGpioPin : int
 {
@@ -56,6 +73,7 @@ enum class InkyCommand : uint8_t
   SSD1683_WRITE_RAM = 0x24,
   SSD1683_WRITE_ALTRAM = 0x26,
   SSD1683_READ_RAM = 0x25,
+  SSD1683_READ_RAM_OPTION = 0x41,
   SSD1683_VCOM_SENSE = 0x2B,
   SSD1683_VCOM_DURATION = 0x2C,
   SSD1683_WRITE_VCOM = 0x2C,
@@ -106,30 +124,256 @@ Inky::~Inky() {}
 class InkyBase : public Inky
 {
 protected:
-  std::mutex mutex_;
+  // frameMutex_ guards the buffered frame and border, deviceMutex_ the panel and everything
+  // below that describes it. A refresh only holds deviceMutex_, so setImage never waits on one.
+  mutable std::mutex frameMutex_;
+  mutable std::mutex deviceMutex_;
   DisplayInfo info_;
   IndexedColor border_;
-  Image buf_;
   IndexedColorMap colorMap_;
   Gpio gpio_;
   SPIDevice spi_;
+  // A frame in the panel's wire format. It never changes once made, so the buffer and the
+  // refreshes using it share one instead of copying.
+  struct PackedPayload
+  {
+    std::vector<std::vector<uint8_t>> planes;
+    // Hash of planes, taken when they were packed so show doesn't have to
+    uint64_t hash = 0;
+  };
+  // The buffered image. setImage swaps in a new payload rather than packing in to this one.
+  std::shared_ptr<const PackedPayload> frame_;
+  // ColorTest and CleanDisplay never change, so they are packed once by packFrames
+  std::shared_ptr<const PackedPayload> colorTestFrame_;
+  std::shared_ptr<const PackedPayload> cleanFrame_;
+  IncrementalDither incrementalDither_;
+  RefreshMode refreshMode_ = RefreshMode::Standard;
+  // The border and waveform for the refresh in progress
+  IndexedColor frontBorder_;
+  RefreshMode frontRefreshMode_ = RefreshMode::Standard;
+  // Fingerprint of what is on the glass, valid only after a transmit completed
+  bool shownValid_ = false;
+  uint64_t shownHash_ = 0;
+  uint64_t skippedRefreshes_ = 0;
+  // The planes on the glass, kept only for panels that refresh partially, as partial
+  // refreshes need the old contents of the window
+  std::vector<std::vector<uint8_t>> shownPlanes_;
+  // Partial refreshes since the last full one, and how many are allowed before a full one
+  int partialRefreshes_ = 0;
+  int fullRefreshInterval_ = 10;
+
+  // What the controller is known to be doing between refreshes
+  enum class SessionState
+  {
+    NeedsHardReset, // Unknown state, e.g. just constructed or after an error
+    Initialized,    // Registers configured and the panel powered
+    Sleeping        // Registers configured but the panel powered off
+  };
+  SessionState session_ = SessionState::NeedsHardReset;
+  // Last data written to each configuration register since the last hard reset
+  std::map<InkyCommand, std::vector<uint8_t>> registers_;
+
+  // BUSY line level as last seen, kept up to date by gpio edge events
+  std::mutex busyMutex_;
+  std::condition_variable busyChanged_;
+  bool busySubscribed_ = false;
+  int busyLevel_ = 0;
+  uint64_t busyEdges_ = 0;
+  std::chrono::steady_clock::time_point busyEdgeTime_;
+  // Whether BUSY has ever been seen asserted, i.e. whether the line is connected at all
+  bool busySeen_ = false;
+
+  // Phase timings of the refresh in progress and of the last finished one
+  std::vector<PhaseTiming> timings_;
+  std::vector<PhaseTiming> lastTimings_;
+  bool phaseOpen_ = false;
+  std::chrono::steady_clock::time_point phaseStart_;
+  // Where to report the phase of the refresh in progress, if it came from showAsync
+  std::shared_ptr<ShowProgress> progress_;
+
+  // A refresh captured by show or showAsync, waiting to run
+  struct ShowJob
+  {
+    ShowOperation op;
+    bool force;
+    IndexedColor border;
+    RefreshMode mode;
+    std::shared_ptr<const PackedPayload> frame;
+    std::shared_ptr<ShowProgress> progress;
+    std::promise<void> done;
+  };
+
+  // The worker thread running showAsync jobs in order, started by the first one
+  std::thread worker_;
+  std::mutex jobsMutex_;
+  std::condition_variable jobsChanged_;
+  std::deque<ShowJob> jobs_;
+  bool stopWorker_ = false;
 
   InkyBase(DisplayInfo info, uint32_t spiSpeedHz = 488000, uint32_t spiTransferSizeBytes = 4096, SPIMode spiMode = SPIMode::SPI_MODE_0); 
+  virtual ~InkyBase();
 
   virtual void setImage(const Image& image, ScaleSettings scale, DitherSettings dither) override;
   virtual Image getImage() const override;
   virtual void setBorder(IndexedColor color) override;
+  virtual void setRefreshMode(RefreshMode mode) override;
   virtual const DisplayInfo& info() const override;
   virtual const IndexedColorMap& getColorMap() const override;
+  virtual void show(ShowOperation op, bool force) override;
+  virtual void waitForRefresh() override;
+  virtual ShowHandle showAsync(ShowOperation op, bool force) override;
+  virtual PackedFrame packFrame(ShowOperation op) override;
+  virtual void show(const PackedFrame& frame, bool force) override;
+  virtual void show(const BoundingBox& region, bool force) override;
+  virtual void setFullRefreshInterval(int partialRefreshes) override;
+  virtual uint32_t calibrateSpiClock() override;
+  virtual void setSpiClock(uint32_t hz) override;
+  virtual uint32_t spiClock() const override;
+  virtual uint64_t skippedRefreshes() const override;
+  virtual std::vector<PhaseTiming> lastShowTimings() const override;
+
+  // Size planes for a full frame in the panel's native format, one buffer per display RAM plane
+  virtual void preparePlanes(std::vector<std::vector<uint8_t>>& planes) const = 0;
+  // Pack one finished row of indexed pixels into planes made by preparePlanes
+  virtual void packRow(int y, const IndexedColor* row, std::vector<std::vector<uint8_t>>& planes) const = 0;
+  // Rebuild the indexed image a set of packed planes shows
+  virtual void unpack(const std::vector<std::span<const uint8_t>>& planes, Image& img) const = 0;
+  // Write packed planes to the panel and refresh it, with frontBorder_ as the border and
+  // frontRefreshMode_ as the waveform.
+  // Called with deviceMutex_ held.
+  virtual void transmit(const std::vector<std::span<const uint8_t>>& planes) = 0;
+  // Whether the panel can refresh a window of the glass with transmitPartial
+  virtual bool canRefreshPartially() const;
+  // Write the part of planes inside region to the panel and refresh just that, updating
+  // shownPlanes_ to match. region is clipped to the panel but may need aligning to its RAM.
+  // Returns false without touching the panel if the window already shows planes, unless force
+  // is set. Called with deviceMutex_ held, only when canRefreshPartially and the glass is known.
+  virtual bool transmitPartial(const std::vector<std::span<const uint8_t>>& planes, const BoundingBox& region, bool force);
+  // Block until a refresh that transmit or transmitPartial left running is done.
+  // Called with deviceMutex_ held.
+  virtual void finishRefresh();
+  // Write a test pattern to display RAM at hz and check it reads back, for calibrateSpiClock.
+  // Called with deviceMutex_ held. Throws if the panel can't read back its RAM.
+  virtual bool testSpiClock(uint32_t hz);
+  // The color used to fill the panel for ShowOperation::CleanDisplay
+  virtual IndexedColor cleanColor() const;
+
+  // A register and the data to write to it. The data is held inline, so a table of these owns
+  // its bytes and writeRegisters can send them without copying.
+  struct RegisterWrite
+  {
+    InkyCommand command;
+    std::array<uint8_t, 8> data {};
+    size_t size = 0;
+    RegisterWrite(InkyCommand command, std::initializer_list<uint8_t> bytes);
+    std::span<const uint8_t> bytes() const { return {data.data(), size}; }
+  };
 
   void sendCommand(InkyCommand command);
   template <typename T> void sendCommand(InkyCommand command, const T& data);
-  static void generatePackedIndex(const Image& img, std::vector<uint8_t>& packed);
-  static void generatePackedPlane(const Image& img, std::vector<uint8_t>& packed, IndexedColor color);
+  // Send segments in order, with the DC line set for each. Throws if they weren't all sent.
+  int transact(std::span<const SPISegment> segments);
+  // Like writeRegister for a whole table, skipping the registers that already hold their data
+  // and sending the rest as one transaction
+  void writeRegisters(std::span<const RegisterWrite> table);
+  // Like sendCommand, but skipped if the register already holds data. The cache is only
+  // updated once the write succeeded.
+  template <typename T> void writeRegister(InkyCommand command, const T& data);
+  template <typename T> static std::span<const uint8_t> commandData(const T& data);
+  // Send command, then read data.size() bytes back from the controller
+  void readCommand(InkyCommand command, std::span<uint8_t> data);
+  // Forget everything known about the controller, so the next transmit starts with a hard reset
+  void invalidateSession();
+  // Start tracking BUSY edges. Call once the BUSY line is set up as an input.
+  void subscribeBusy();
+  // Block until BUSY is no longer at busyLevel. If BUSY isn't asserted yet, first give the
+  // controller up to assertGraceMs to raise it. Throws if it stays busy past timeoutMs.
+  void waitForBusyRelease(int busyLevel, int timeoutMs, int assertGraceMs = 0);
+  bool busySeen();
+  // Mark the start of the next phase of the refresh in progress, ending the current one
+  void beginPhase(ShowPhase phase);
+  void endPhase();
+  void pack(const Image& img, std::vector<std::vector<uint8_t>>& planes) const;
+  std::shared_ptr<const PackedPayload> makePayload(const Image& img) const;
+  // Pack the blank buffered image and the test patterns. Derived constructors must call this
+  // once preparePlanes and packRow work.
+  void packFrames();
+  // The frame for op. Call with frameMutex_ held.
+  std::shared_ptr<const PackedPayload> payload(ShowOperation op) const;
+  void transmitIfChanged(ShowOperation op, const std::vector<std::span<const uint8_t>>& planes, uint64_t planesHash, bool force);
+  uint64_t frameHash(ShowOperation op, uint64_t planesHash) const;
+  static uint64_t hashPlanes(const std::vector<std::span<const uint8_t>>& planes);
+  ShowJob captureShow(ShowOperation op, bool force) const;
+  void runShow(ShowJob& job);
+  // runShow for callers already holding deviceMutex_
+  void runShowLocked(ShowJob& job);
+  void workerLoop();
+  // Finish the refresh in flight and fail the queued ones. Derived destructors must call
+  // this, the worker calls transmit so it can't outlive the derived class.
+  void stopWorker();
+  static std::vector<std::span<const uint8_t>> planeSpans(const std::vector<std::vector<uint8_t>>& planes);
+  static void packNibbleRow(int y, const IndexedColor* row, int width, std::vector<uint8_t>& packed);
+  static void unpackNibbles(std::span<const uint8_t> packed, Image& img);
   static void sleep(double milliseconds);
-  Image generateColorTest();
+  Image generateColorTest() const;
+  Image generateCleanImage() const;
 };
 
+// Units of one variant are told apart by the time their EEPROM was written
+static std::string spiClockKey(const Inky::DisplayInfo& info)
+{
+  return fmt::format("{} {}", (int)info.displayVariant, info.writeTime);
+}
+
+// The saved SPI clock for this unit, or 0 if there isn't one
+static uint32_t loadSpiClock(const Inky::DisplayInfo& info)
+{
+  std::ifstream file(InkySPIClockFile);
+  std::string key = spiClockKey(info);
+  std::string line;
+  while (std::getline(file, line))
+  {
+    // Each line is the clock in Hz then the unit's key
+    size_t split = line.find(' ');
+    if (split != std::string::npos && line.substr(split + 1) == key)
+    {
+      return (uint32_t)std::strtoul(line.c_str(), nullptr, 10);
+    }
+  }
+  return 0;
+}
+
+static void saveSpiClock(const Inky::DisplayInfo& info, uint32_t hz)
+{
+  std::string key = spiClockKey(info);
+  std::vector<std::string> lines;
+  {
+    std::ifstream file(InkySPIClockFile);
+    std::string line;
+    while (std::getline(file, line))
+    {
+      size_t split = line.find(' ');
+      if (split == std::string::npos || line.substr(split + 1) != key)
+      {
+        lines.push_back(line);
+      }
+    }
+  }
+  lines.push_back(fmt::format("{} {}", hz, key));
+
+  std::error_code error;
+  std::filesystem::create_directories(std::filesystem::path(InkySPIClockFile).parent_path(), error);
+  std::ofstream file(InkySPIClockFile, std::ios::trunc);
+  for (const auto& line : lines)
+  {
+    file << line << '\n';
+  }
+  if (!file)
+  {
+    throw std::runtime_error(fmt::format("Failed to save the SPI clock to {}", InkySPIClockFile));
+  }
+}
+
 InkyBase::InkyBase(DisplayInfo displayInfo, uint32_t spiSpeedHz, uint32_t spiTransferSizeBytes, SPIMode spiMode) : 
   info_(displayInfo),
   gpio_(InkyGPIODevice),
@@ -158,7 +402,7 @@ InkyBase::InkyBase(DisplayInfo displayInfo, uint32_t spiSpeedHz, uint32_t spiTra
       {
         {ColorName::White, 0, {255,255,255}},
         {ColorName::Black, 1, {0,0,0}},
-        {ColorName::Red, 2, {255,0,0}}
+        {ColorName::Yellow, 2, {255,255,0}}
       };
       break;
     case ColorCapability::SevenColor:
@@ -186,7 +430,23 @@ InkyBase::InkyBase(DisplayInfo displayInfo, uint32_t spiSpeedHz, uint32_t spiTra
   colorMap_ = IndexedColorMap(displayColors);
   //colorMap_.normalizePaletteByLab(false, true);
   border_ = colorMap_.toIndexedColor(ColorName::White);
-  buf_ = Image(info_.width, info_.height, colorMap_);
+  frontBorder_ = border_;
+
+  uint32_t savedSpiClock = loadSpiClock(info_);
+  if (savedSpiClock > 0)
+  {
+    spi_.setBusSpeed(savedSpiClock);
+  }
+}
+
+InkyBase::~InkyBase()
+{
+  // Normally already stopped by the derived destructor, but a joinable thread can't be destroyed
+  stopWorker();
+  if (busySubscribed_)
+  {
+    gpio_.unsubscribe(InkyGpioPin::BUSY_PIN);
+  }
 }
 
 const IndexedColorMap& InkyBase::getColorMap() const
@@ -196,59 +456,237 @@ const IndexedColorMap& InkyBase::getColorMap() const
 
 void InkyBase::sendCommand(InkyCommand command)
 {
-  gpio_.write(InkyGpioPin::DC_PIN, false);
+  SPISegment segment {.dataCommand = false, .data = {(const uint8_t*)(&command), 1}};
   #ifdef DEBUG_SPI
   std::cout << "Command " << command << " ret: " << 
   #endif
-  spi_.write((uint8_t*)(&command), 1);
+  transact({&segment, 1});
   #ifdef DEBUG_SPI
   std::cout << std::endl;
   #endif
 }
 
-template <typename T>
-void InkyBase::sendCommand(InkyCommand command, const T& data)
+int InkyBase::transact(std::span<const SPISegment> segments)
 {
-  sendCommand(command);
+  int ret = spi_.transact(segments, [this](bool dataCommand)
+  {
+    gpio_.write(InkyGpioPin::DC_PIN, dataCommand);
+  });
+  if (ret < 0)
+  {
+    throw std::runtime_error("Failed to send to the display over SPI!");
+  }
+  return ret;
+}
+
+InkyBase::RegisterWrite::RegisterWrite(InkyCommand command, std::initializer_list<uint8_t> bytes) :
+  command(command),
+  size(bytes.size())
+{
+  if (bytes.size() > data.size())
+  {
+    throw std::invalid_argument(fmt::format("Register data is {} bytes, at most {} fit in a register table", bytes.size(), data.size()));
+  }
+  std::copy(bytes.begin(), bytes.end(), data.begin());
+}
 
-  size_t len = 0;
-  const uint8_t* dataPtr = nullptr;
+void InkyBase::writeRegisters(std::span<const RegisterWrite> table)
+{
+  // The registers that changed go out as one transaction straight from the table
+  std::vector<SPISegment> segments;
+  segments.reserve(table.size() * 2);
+  for (const auto& reg : table)
+  {
+    auto cached = registers_.find(reg.command);
+    if (cached != registers_.end() && std::ranges::equal(reg.bytes(), cached->second))
+    {
+      continue;
+    }
+    segments.push_back({.dataCommand = false, .data = {(const uint8_t*)(&reg.command), 1}});
+    segments.push_back({.dataCommand = true, .data = reg.bytes()});
+  }
+  if (segments.empty())
+  {
+    return;
+  }
+  #ifdef DEBUG_SPI
+  std::cout << "Register table of " << segments.size() / 2 << " ret: " << 
+  #endif
+  transact(segments);
+  #ifdef DEBUG_SPI
+  std::cout << std::endl;
+  #endif
+  // transact throws if the controller didn't get them, so only what was sent is cached
+  for (size_t i = 0; i < segments.size(); i += 2)
+  {
+    registers_[(InkyCommand)segments[i].data[0]].assign(segments[i + 1].data.begin(), segments[i + 1].data.end());
+  }
+}
 
+template <typename T>
+std::span<const uint8_t> InkyBase::commandData(const T& data)
+{
   if constexpr(std::is_same<T, std::initializer_list<uint8_t>>())
   {
-    len = data.size();
-    dataPtr = std::data(data);
+    return {std::data(data), data.size()};
   }
-  else if constexpr(std::is_same<T, std::vector<uint8_t>>())
+  else if constexpr(std::is_same<T, std::vector<uint8_t>>() || std::is_same<T, std::span<const uint8_t>>())
   {
-    len = data.size();
-    dataPtr = data.data();
+    return {data.data(), data.size()};
   }
   else if constexpr(std::is_arithmetic<T>())
   {
-    len = sizeof(T);
-    dataPtr = (uint8_t*)(&data);
+    return {(const uint8_t*)(&data), sizeof(T)};
   }
   else if constexpr(std::is_trivial<T>() && std::is_standard_layout<T>())
   {
-    len = sizeof(T);
-    dataPtr = (uint8_t*)(&data);
+    return {(const uint8_t*)(&data), sizeof(T)};
   }
   else
   {
     static_assert(std::is_trivial<T>() && std::is_standard_layout<T>(), "Unsupported data type!");
   }
+}
 
-  gpio_.write(InkyGpioPin::DC_PIN, true);
+template <typename T>
+void InkyBase::sendCommand(InkyCommand command, const T& data)
+{
+  SPISegment segments[] =
+  {
+    {.dataCommand = false, .data = {(const uint8_t*)(&command), 1}},
+    {.dataCommand = true, .data = commandData(data)}
+  };
   #ifdef DEBUG_SPI
-  std::cout << "Sent buffer len " << len << " ret: " << 
+  std::cout << "Command " << command << " with buffer len " << segments[1].data.size() << " ret: " << 
   #endif
-  spi_.write(dataPtr, len);
+  transact(segments);
   #ifdef DEBUG_SPI
   std::cout << std::endl;
   #endif
 }
 
+template <typename T>
+void InkyBase::writeRegister(InkyCommand command, const T& data)
+{
+  std::span<const uint8_t> bytes = commandData(data);
+  auto cached = registers_.find(command);
+  if (cached != registers_.end() && std::equal(bytes.begin(), bytes.end(), cached->second.begin(), cached->second.end()))
+  {
+    return;
+  }
+  // sendCommand throws if the controller didn't get the data, so only a register that was
+  // really written gets cached
+  sendCommand(command, bytes);
+  registers_[command].assign(bytes.begin(), bytes.end());
+}
+
+void InkyBase::readCommand(InkyCommand command, std::span<uint8_t> data)
+{
+  sendCommand(command);
+  gpio_.write(InkyGpioPin::DC_PIN, true);
+  spi_.read(data.data(), data.size());
+}
+
+void InkyBase::invalidateSession()
+{
+  session_ = SessionState::NeedsHardReset;
+  registers_.clear();
+}
+
+void InkyBase::subscribeBusy()
+{
+  gpio_.subscribe(InkyGpioPin::BUSY_PIN, [this](int /*line*/, Gpio::LineTransition transition, std::chrono::steady_clock::time_point timestamp)
+  {
+    std::lock_guard lock(busyMutex_);
+    busyLevel_ = (transition == Gpio::LineTransition::RisingEdge) ? 1 : 0;
+    busyEdgeTime_ = timestamp;
+    ++busyEdges_;
+    busyChanged_.notify_all();
+  });
+  busySubscribed_ = true;
+}
+
+bool InkyBase::busySeen()
+{
+  std::lock_guard lock(busyMutex_);
+  return busySeen_;
+}
+
+void InkyBase::waitForBusyRelease(int busyLevel, int timeoutMs, int assertGraceMs)
+{
+  // Edges wake the wait straight away. The pin is also re-read every so often
+  // in case an edge was missed, so a lost event costs time rather than a timeout.
+  static const auto RecheckInterval = std::chrono::milliseconds(100);
+
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::milliseconds(timeoutMs);
+  std::unique_lock lock(busyMutex_);
+  busyLevel_ = gpio_.read(InkyGpioPin::BUSY_PIN);
+
+  if (busyLevel_ != busyLevel && assertGraceMs > 0)
+  {
+    uint64_t edges = busyEdges_;
+    busyChanged_.wait_until(lock, std::min(deadline, start + std::chrono::milliseconds(assertGraceMs)), [&]
+    {
+      return busyEdges_ != edges;
+    });
+    busyLevel_ = gpio_.read(InkyGpioPin::BUSY_PIN);
+  }
+
+  bool releasedByEdge = false;
+  if (busyLevel_ == busyLevel)
+  {
+    busySeen_ = true;
+  }
+  while (busyLevel_ == busyLevel)
+  {
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline)
+    {
+      throw std::runtime_error("Timed out while wating for display to finish an operation.");
+    }
+    busyChanged_.wait_until(lock, std::min(deadline, now + RecheckInterval));
+    releasedByEdge = busyLevel_ != busyLevel;
+    if (!releasedByEdge)
+    {
+      busyLevel_ = gpio_.read(InkyGpioPin::BUSY_PIN);
+    }
+  }
+
+  auto woke = std::chrono::steady_clock::now();
+  if (phaseOpen_)
+  {
+    PhaseTiming& timing = timings_.back();
+    timing.busyWaitMilliseconds += std::chrono::duration<double, std::milli>(woke - start).count();
+    if (releasedByEdge)
+    {
+      timing.busyWakeLatencyMilliseconds = std::max(timing.busyWakeLatencyMilliseconds,
+        std::chrono::duration<double, std::milli>(woke - busyEdgeTime_).count());
+    }
+  }
+}
+
+void InkyBase::beginPhase(ShowPhase phase)
+{
+  endPhase();
+  timings_.push_back({.phase = phase});
+  phaseStart_ = std::chrono::steady_clock::now();
+  phaseOpen_ = true;
+  if (progress_)
+  {
+    progress_->phase = phase;
+  }
+}
+
+void InkyBase::endPhase()
+{
+  if (phaseOpen_)
+  {
+    timings_.back().milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - phaseStart_).count();
+    phaseOpen_ = false;
+  }
+}
+
 const Inky::DisplayInfo& InkyBase::info() const 
 {
   return info_;
@@ -256,66 +694,527 @@ const Inky::DisplayInfo& InkyBase::info() const
 
 void InkyBase::setImage(const Image& image, ScaleSettings scale, DitherSettings dither)
 {
-  std::lock_guard lock(mutex_);
-  buf_ = image;
-  buf_.scale(info_.width, info_.height, scale);
-  buf_.toIndexed(colorMap_, dither);
+  Image scaled = image;
+  scaled.scale(info_.width, info_.height, scale);
+  scaled.toRGBA();
+
+  auto payload = std::make_shared<PackedPayload>();
+  if (dither.incremental)
+  {
+    // Images already at the panel size keep their damage, so only those regions get compared.
+    // The ditherer's state belongs to the buffer, so this part runs under the lock.
+    std::lock_guard lock(frameMutex_);
+    pack(incrementalDither_.dither(scaled, colorMap_, dither), payload->planes);
+    payload->hash = hashPlanes(planeSpans(payload->planes));
+    frame_ = payload;
+    return;
+  }
+
+  // Each row goes straight from the dither in to the wire format, there is no indexed frame.
+  // The new payload isn't shared yet, so shows can capture the current one meanwhile.
+  preparePlanes(payload->planes);
+  auto sink = [&](int y, const IndexedColor* row)
+  {
+    packRow(y, row, payload->planes);
+  };
+  if (dither.ditherMode == DitherMode::Pattern)
+  {
+    patternDither(scaled, colorMap_, sink);
+  }
+  else
+  {
+    diffusionDither(scaled, colorMap_, sink, dither.ditherAccuracy);
+  }
+  payload->hash = hashPlanes(planeSpans(payload->planes));
+
+  std::lock_guard lock(frameMutex_);
+  frame_ = payload;
 }
 
 Image InkyBase::getImage() const
 {
-  return buf_;
+  std::shared_ptr<const PackedPayload> frame;
+  {
+    std::lock_guard lock(frameMutex_);
+    frame = frame_;
+  }
+  Image img(info_.width, info_.height, colorMap_);
+  unpack(planeSpans(frame->planes), img);
+  return img;
 }
 
 void InkyBase::setBorder(IndexedColor inky)
 {
-  std::lock_guard lock(mutex_);
+  std::lock_guard lock(frameMutex_);
   border_ = inky;
 }
 
-void InkyBase::generatePackedIndex(const Image& img, std::vector<uint8_t>& packed)
+void InkyBase::setRefreshMode(RefreshMode mode)
 {
-  // Pack the image buffer so that each value is 4 bytes, 2 pixels per byte
-  // buf = ((buf[::2] << 4) & 0xF0) | (buf[1::2] & 0x0F)
-  packed.resize(img.width() * img.height() / 2);
-  const IndexedColor* bufData = (IndexedColor*)img.data();
-  for (int i = 0; i < packed.size(); ++i)
+  std::lock_guard lock(frameMutex_);
+  refreshMode_ = mode;
+}
+
+void InkyBase::show(ShowOperation op, bool force)
+{
+  ShowJob job = captureShow(op, force);
+  runShow(job);
+}
+
+void InkyBase::waitForRefresh()
+{
+  std::lock_guard lock(deviceMutex_);
+  try
+  {
+    finishRefresh();
+  }
+  catch (...)
   {
-    packed[i] = (uint8_t)((bufData[i*2] << 4) | (bufData[i*2+1] & 0x0F));
+    // The glass and the controller are as unknown as after a failed transmit
+    shownValid_ = false;
+    invalidateSession();
+    throw;
   }
 }
 
-void InkyBase::generatePackedPlane(const Image& img, std::vector<uint8_t>& packed, IndexedColor color)
+Inky::ShowHandle InkyBase::showAsync(ShowOperation op, bool force)
 {
-  int size = (img.width()*img.height());
-  int wholeBytes = size/8;
-  int packedSize = size/8 + ((size%8 != 0) ? 1 : 0);
-  packed.resize(packedSize);
-  const IndexedColor* inkyData = (const IndexedColor*)img.data();
-  for (int i = 0; i < wholeBytes; ++i)
+  ShowJob job = captureShow(op, force);
+  job.progress = std::make_shared<ShowProgress>();
+  job.progress->done = job.done.get_future().share();
+  ShowHandle handle = job.progress;
+
+  std::lock_guard lock(jobsMutex_);
+  if (stopWorker_)
+  {
+    throw std::runtime_error("The display is shutting down!");
+  }
+  if (!worker_.joinable())
+  {
+    worker_ = std::thread(&InkyBase::workerLoop, this);
+  }
+  jobs_.push_back(std::move(job));
+  jobsChanged_.notify_all();
+  return handle;
+}
+
+InkyBase::ShowJob InkyBase::captureShow(ShowOperation op, bool force) const
+{
+  ShowJob job {.op = op, .force = force};
+  std::lock_guard lock(frameMutex_);
+  job.border = border_;
+  job.mode = refreshMode_;
+  job.frame = payload(op);
+  return job;
+}
+
+void InkyBase::runShow(ShowJob& job)
+{
+  std::lock_guard lock(deviceMutex_);
+  runShowLocked(job);
+}
+
+void InkyBase::runShowLocked(ShowJob& job)
+{
+  progress_ = job.progress;
+  timings_.clear();
+  phaseOpen_ = false;
+  try
+  {
+    // Every frame is packed before it's shown, so this phase is just the check for a skip
+    beginPhase(ShowPhase::Packing);
+    frontBorder_ = job.border;
+    frontRefreshMode_ = job.mode;
+    transmitIfChanged(job.op, planeSpans(job.frame->planes), job.frame->hash, job.force);
+  }
+  catch (...)
   {
-    packed[i] = ((inkyData[i*8+0] == color) ? (uint8_t)0b10000000 : (uint8_t)0) | 
-                ((inkyData[i*8+1] == color) ? (uint8_t)0b01000000 : (uint8_t)0) |
-                ((inkyData[i*8+2] == color) ? (uint8_t)0b00100000 : (uint8_t)0) |
-                ((inkyData[i*8+3] == color) ? (uint8_t)0b00010000 : (uint8_t)0) |
-                ((inkyData[i*8+4] == color) ? (uint8_t)0b00001000 : (uint8_t)0) |
-                ((inkyData[i*8+5] == color) ? (uint8_t)0b00000100 : (uint8_t)0) |
-                ((inkyData[i*8+6] == color) ? (uint8_t)0b00000010 : (uint8_t)0) |
-                ((inkyData[i*8+7] == color) ? (uint8_t)0b00000001 : (uint8_t)0);
+    progress_ = nullptr;
+    throw;
+  }
+  progress_ = nullptr;
+}
+
+void InkyBase::workerLoop()
+{
+  std::unique_lock lock(jobsMutex_);
+  while (true)
+  {
+    jobsChanged_.wait(lock, [&]
+    {
+      return stopWorker_ || !jobs_.empty();
+    });
+    if (stopWorker_)
+    {
+      break;
+    }
+
+    ShowJob job = std::move(jobs_.front());
+    jobs_.pop_front();
+    lock.unlock();
+    try
+    {
+      runShow(job);
+      job.done.set_value();
+    }
+    catch (...)
+    {
+      job.done.set_exception(std::current_exception());
+    }
+    lock.lock();
   }
 
-  // Get that sneaky final byte and write to it
-  if (packedSize > wholeBytes)
+  for (auto& job : jobs_)
   {
-    packed[wholeBytes] = 0;
-    if (wholeBytes*8+0 < size) packed[wholeBytes] |= ((inkyData[wholeBytes*8+0] == color) ? (uint8_t)0b00000001 : (uint8_t)0); 
-    if (wholeBytes*8+1 < size) packed[wholeBytes] |= ((inkyData[wholeBytes*8+1] == color) ? (uint8_t)0b00000010 : (uint8_t)0);
-    if (wholeBytes*8+2 < size) packed[wholeBytes] |= ((inkyData[wholeBytes*8+2] == color) ? (uint8_t)0b00000100 : (uint8_t)0);
-    if (wholeBytes*8+3 < size) packed[wholeBytes] |= ((inkyData[wholeBytes*8+3] == color) ? (uint8_t)0b00001000 : (uint8_t)0);
-    if (wholeBytes*8+4 < size) packed[wholeBytes] |= ((inkyData[wholeBytes*8+4] == color) ? (uint8_t)0b00010000 : (uint8_t)0);
-    if (wholeBytes*8+5 < size) packed[wholeBytes] |= ((inkyData[wholeBytes*8+5] == color) ? (uint8_t)0b00100000 : (uint8_t)0);
-    if (wholeBytes*8+6 < size) packed[wholeBytes] |= ((inkyData[wholeBytes*8+6] == color) ? (uint8_t)0b01000000 : (uint8_t)0);
-    if (wholeBytes*8+7 < size) packed[wholeBytes] |= ((inkyData[wholeBytes*8+7] == color) ? (uint8_t)0b10000000 : (uint8_t)0);
+    job.done.set_exception(std::make_exception_ptr(std::runtime_error("The display shut down before this refresh ran")));
+  }
+  jobs_.clear();
+}
+
+void InkyBase::stopWorker()
+{
+  {
+    std::lock_guard lock(jobsMutex_);
+    stopWorker_ = true;
+    jobsChanged_.notify_all();
+  }
+  if (worker_.joinable())
+  {
+    worker_.join();
+  }
+}
+
+PackedFrame InkyBase::packFrame(ShowOperation op)
+{
+  std::shared_ptr<const PackedPayload> frame;
+  {
+    std::lock_guard lock(frameMutex_);
+    frame = payload(op);
+  }
+  return
+  {
+    .displayVariant = (uint8_t)info_.displayVariant,
+    .width = info_.width,
+    .height = info_.height,
+    .colorMap = colorMap_,
+    .planes = planeSpans(frame->planes),
+    .storage = frame
+  };
+}
+
+void InkyBase::show(const PackedFrame& frame, bool force)
+{
+  if (frame.displayVariant != (uint8_t)info_.displayVariant || 
+      frame.width != info_.width || 
+      frame.height != info_.height)
+  {
+    throw std::runtime_error("Packed frame was made for a different display!");
+  }
+  // A stale or hand made file can still name this display, and the drivers trust the plane sizes
+  std::vector<std::vector<uint8_t>> expected;
+  preparePlanes(expected);
+  if (frame.planes.size() != expected.size())
+  {
+    throw std::runtime_error(fmt::format("Packed frame has {} planes, this display needs {}!", frame.planes.size(), expected.size()));
+  }
+  for (size_t i = 0; i < expected.size(); ++i)
+  {
+    if (frame.planes[i].size() != expected[i].size())
+    {
+      throw std::runtime_error(fmt::format("Packed frame plane {} is {} bytes, this display needs {}!", i, frame.planes[i].size(), expected[i].size()));
+    }
+  }
+  uint64_t planesHash = hashPlanes(frame.planes);
+  IndexedColor border;
+  RefreshMode mode;
+  {
+    std::lock_guard lock(frameMutex_);
+    border = border_;
+    mode = refreshMode_;
+  }
+  std::lock_guard lock(deviceMutex_);
+  timings_.clear();
+  phaseOpen_ = false;
+  frontBorder_ = border;
+  frontRefreshMode_ = mode;
+  transmitIfChanged(ShowOperation::BufferedImage, frame.planes, planesHash, force);
+}
+
+void InkyBase::show(const BoundingBox& region, bool force)
+{
+  ShowJob job = captureShow(ShowOperation::BufferedImage, force);
+  std::lock_guard lock(deviceMutex_);
+  // A partial refresh only drives the pixels in the window, so it needs to know what the rest
+  // of the glass shows and can't change the border
+  if (!canRefreshPartially() || !shownValid_ || session_ == SessionState::NeedsHardReset ||
+      job.border != frontBorder_ || partialRefreshes_ >= fullRefreshInterval_)
+  {
+    runShowLocked(job);
+    return;
+  }
+
+  BoundingBox window = region;
+  window.clipTo({.x = 0, .y = 0, .width = info_.width, .height = info_.height});
+  if (window.empty())
+  {
+    ++skippedRefreshes_;
+    return;
+  }
+
+  timings_.clear();
+  phaseOpen_ = false;
+  bool refreshed = false;
+  try
+  {
+    beginPhase(ShowPhase::Packing);
+    refreshed = transmitPartial(planeSpans(job.frame->planes), window, force);
+  }
+  catch (...)
+  {
+    endPhase();
+    shownValid_ = false;
+    invalidateSession();
+    throw;
+  }
+  endPhase();
+  if (!refreshed)
+  {
+    ++skippedRefreshes_;
+    return;
+  }
+  ++partialRefreshes_;
+  lastTimings_ = timings_;
+  shownHash_ = frameHash(ShowOperation::BufferedImage, hashPlanes(planeSpans(shownPlanes_)));
+}
+
+void InkyBase::setFullRefreshInterval(int partialRefreshes)
+{
+  if (partialRefreshes < 0)
+  {
+    throw std::invalid_argument(fmt::format("Full refresh interval must not be negative, got {}!", partialRefreshes));
+  }
+  std::lock_guard lock(deviceMutex_);
+  fullRefreshInterval_ = partialRefreshes;
+}
+
+uint32_t InkyBase::calibrateSpiClock()
+{
+  std::lock_guard lock(deviceMutex_);
+  uint32_t original = spi_.busSpeed();
+  uint32_t fastest = 0;
+  try
+  {
+    for (uint32_t hz : SPIClockSteps)
+    {
+      if (!testSpiClock(hz))
+      {
+        break;
+      }
+      fastest = hz;
+    }
+  }
+  catch (...)
+  {
+    spi_.setBusSpeed(original);
+    invalidateSession();
+    throw;
+  }
+  // A garbled write may have hit any register, so start the next refresh from a hard reset
+  invalidateSession();
+  if (fastest == 0)
+  {
+    spi_.setBusSpeed(original);
+    throw std::runtime_error("Display RAM didn't read back even at the slowest SPI clock, set a known good one with setSpiClock!");
+  }
+
+  uint32_t hz = fastest / 100 * SPIClockMarginPercent;
+  spi_.setBusSpeed(hz);
+  saveSpiClock(info_, hz);
+  return hz;
+}
+
+void InkyBase::setSpiClock(uint32_t hz)
+{
+  if (hz == 0)
+  {
+    throw std::invalid_argument("SPI clock must not be zero!");
+  }
+  std::lock_guard lock(deviceMutex_);
+  spi_.setBusSpeed(hz);
+  saveSpiClock(info_, hz);
+}
+
+uint32_t InkyBase::spiClock() const
+{
+  std::lock_guard lock(deviceMutex_);
+  return spi_.busSpeed();
+}
+
+bool InkyBase::testSpiClock(uint32_t /*hz*/)
+{
+  throw std::runtime_error("This display can't read back its RAM, set a known good SPI clock with setSpiClock!");
+}
+
+uint64_t InkyBase::skippedRefreshes() const
+{
+  std::lock_guard lock(deviceMutex_);
+  return skippedRefreshes_;
+}
+
+std::vector<Inky::PhaseTiming> InkyBase::lastShowTimings() const
+{
+  std::lock_guard lock(deviceMutex_);
+  return lastTimings_;
+}
+
+uint64_t InkyBase::hashPlanes(const std::vector<std::span<const uint8_t>>& planes)
+{
+  Hash64 hash;
+  for (const auto& plane : planes)
+  {
+    hash.updateValue(plane.size());
+    hash.update(plane);
+  }
+  return hash.digest();
+}
+
+uint64_t InkyBase::frameHash(ShowOperation op, uint64_t planesHash) const
+{
+  Hash64 hash;
+  hash.updateValue(op);
+  hash.updateValue(frontBorder_);
+  hash.updateValue(planesHash);
+  return hash.digest();
+}
+
+void InkyBase::transmitIfChanged(ShowOperation op, const std::vector<std::span<const uint8_t>>& planes, uint64_t planesHash, bool force)
+{
+  uint64_t hash = frameHash(op, planesHash);
+
+  if (!force && shownValid_ && hash == shownHash_)
+  {
+    ++skippedRefreshes_;
+    return;
+  }
+
+  // If the transmit throws part way the glass is in an unknown state, so nothing matches it,
+  // and neither is the controller, so the next try starts from a hard reset
+  shownValid_ = false;
+  try
+  {
+    transmit(planes);
+  }
+  catch (...)
+  {
+    endPhase();
+    invalidateSession();
+    throw;
+  }
+  endPhase();
+  lastTimings_ = timings_;
+  shownHash_ = hash;
+  shownValid_ = true;
+  partialRefreshes_ = 0;
+  if (canRefreshPartially())
+  {
+    shownPlanes_.assign(planes.size(), {});
+    for (size_t i = 0; i < planes.size(); ++i)
+    {
+      shownPlanes_[i].assign(planes[i].begin(), planes[i].end());
+    }
+  }
+}
+
+bool InkyBase::canRefreshPartially() const
+{
+  return false;
+}
+
+bool InkyBase::transmitPartial(const std::vector<std::span<const uint8_t>>& /*planes*/, const BoundingBox& /*region*/, bool /*force*/)
+{
+  throw std::runtime_error("This display can't refresh part of the panel!");
+}
+
+void InkyBase::finishRefresh()
+{
+}
+
+IndexedColor InkyBase::cleanColor() const
+{
+  return colorMap_.toIndexedColor(ColorName::White);
+}
+
+void InkyBase::pack(const Image& img, std::vector<std::vector<uint8_t>>& planes) const
+{
+  preparePlanes(planes);
+  for (int y = 0; y < img.height(); ++y)
+  {
+    packRow(y, img.data() + y * img.width(), planes);
+  }
+}
+
+std::shared_ptr<const InkyBase::PackedPayload> InkyBase::makePayload(const Image& img) const
+{
+  auto payload = std::make_shared<PackedPayload>();
+  pack(img, payload->planes);
+  payload->hash = hashPlanes(planeSpans(payload->planes));
+  return payload;
+}
+
+void InkyBase::packFrames()
+{
+  frame_ = makePayload(Image(info_.width, info_.height, colorMap_));
+  colorTestFrame_ = makePayload(generateColorTest());
+  cleanFrame_ = makePayload(generateCleanImage());
+}
+
+std::shared_ptr<const InkyBase::PackedPayload> InkyBase::payload(ShowOperation op) const
+{
+  if (op == ShowOperation::ColorTest)
+  {
+    return colorTestFrame_;
+  }
+  else if (op == ShowOperation::CleanDisplay)
+  {
+    return cleanFrame_;
+  }
+  return frame_;
+}
+
+std::vector<std::span<const uint8_t>> InkyBase::planeSpans(const std::vector<std::vector<uint8_t>>& planes)
+{
+  return std::vector<std::span<const uint8_t>>(planes.begin(), planes.end());
+}
+
+void InkyBase::packNibbleRow(int y, const IndexedColor* row, int width, std::vector<uint8_t>& packed)
+{
+  // Two pixels per byte with the first in the high nibble. Rows follow on with no padding,
+  // so with an odd width every other row starts half way through a byte.
+  size_t pixel = (size_t)y * width;
+  int x = 0;
+  if (pixel % 2 == 1 && width > 0)
+  {
+    packed[pixel / 2] = (packed[pixel / 2] & 0xF0) | (row[0] & 0x0F);
+    ++x;
+    ++pixel;
+  }
+  for (; x + 1 < width; x += 2, pixel += 2)
+  {
+    packed[pixel / 2] = (uint8_t)((row[x] << 4) | (row[x+1] & 0x0F));
+  }
+  if (x < width)
+  {
+    packed[pixel / 2] = (uint8_t)((row[x] << 4) | (packed[pixel / 2] & 0x0F));
+  }
+}
+
+void InkyBase::unpackNibbles(std::span<const uint8_t> packed, Image& img)
+{
+  IndexedColor* data = img.data();
+  size_t size = std::min((size_t)img.width() * img.height(), packed.size() * 2);
+  for (size_t i = 0; i < size; ++i)
+  {
+    data[i] = (i % 2 == 0) ? (packed[i / 2] >> 4) : (packed[i / 2] & 0x0F);
   }
 }
 
@@ -334,7 +1233,7 @@ static inline int64_t millisecondsSinceEpoch()
       .count();
 }
 
-Image InkyBase::generateColorTest()
+Image InkyBase::generateColorTest() const
 {
   Image colorTest(info_.width, info_.height, colorMap_);
   auto data = colorTest.data();
@@ -348,11 +1247,23 @@ Image InkyBase::generateColorTest()
   return colorTest;
 }
 
+Image InkyBase::generateCleanImage() const
+{
+  Image cleanImage(info_.width, info_.height, colorMap_);
+  std::fill_n(cleanImage.data(), info_.width * info_.height, cleanColor());
+  return cleanImage;
+}
+
 class SimulatedInky : public InkyBase
 {
   public:
   SimulatedInky();
-  virtual void show(ShowOperation op) override;
+  virtual ~SimulatedInky();
+  protected:
+  virtual void preparePlanes(std::vector<std::vector<uint8_t>>& planes) const override;
+  virtual void packRow(int y, const IndexedColor* row, std::vector<std::vector<uint8_t>>& planes) const override;
+  virtual void unpack(const std::vector<std::span<const uint8_t>>& planes, Image& img) const override;
+  virtual void transmit(const std::vector<std::span<const uint8_t>>& planes) override;
 };
 
 SimulatedInky::SimulatedInky() : InkyBase(
@@ -365,34 +1276,94 @@ SimulatedInky::SimulatedInky() : InkyBase(
     .displayVariant = DisplayVariant::Seven_Colour_640x400_UC8159,
     .writeTime = "2022-09-02 11:54:06.4"
   }, 0
-) {}
+)
+{
+  packFrames();
+}
 
-void SimulatedInky::show(ShowOperation op)
+SimulatedInky::~SimulatedInky()
 {
-  std::lock_guard lock(mutex_);
-  // Write the images to display RAM
-  if (op == ShowOperation::BufferedImage)
-  {
-    ImageIO::SaveToFile(fmt::format("Inky_{}.png", millisecondsSinceEpoch()), buf_, {.saveFormat = ImageFormat::PNG});
-  }
-  else if (op == ShowOperation::ColorTest)
-  {
-    Image colorTest = generateColorTest();
-    ImageIO::SaveToFile(fmt::format("Inky_{}.png", millisecondsSinceEpoch()), colorTest, {.saveFormat = ImageFormat::PNG});
-  }
+  stopWorker();
+}
+
+// Pretend to be a UC8159
+void SimulatedInky::preparePlanes(std::vector<std::vector<uint8_t>>& planes) const
+{
+  planes.resize(1);
+  planes[0].resize(((size_t)info_.width * info_.height + 1) / 2);
+}
+
+void SimulatedInky::packRow(int y, const IndexedColor* row, std::vector<std::vector<uint8_t>>& planes) const
+{
+  packNibbleRow(y, row, info_.width, planes[0]);
+}
+
+void SimulatedInky::unpack(const std::vector<std::span<const uint8_t>>& planes, Image& img) const
+{
+  unpackNibbles(planes[0], img);
+}
+
+void SimulatedInky::transmit(const std::vector<std::span<const uint8_t>>& planes)
+{
+  // Unpack what would have been sent to the display and write it to disk instead
+  beginPhase(ShowPhase::Transfer);
+  Image frame(info_.width, info_.height, colorMap_);
+  unpack(planes, frame);
+  ImageIO::SaveToFile(fmt::format("Inky_{}.qoi", millisecondsSinceEpoch()), frame, {.saveFormat = ImageFormat::QOI});
 }
 
 class InkySSD1683 final : public InkyBase
 {
   private: 
   static const int SPIDeviceSpeedHz = 10000000;
-  std::vector<uint8_t> whitePlane;
-  std::vector<uint8_t> colorPlane;
+  // Display update sequences for DISP_CTRL2, each powering the panel up and back down
+  static const uint8_t UpdateFull = 0xF7;    // Load the temperature and mode 1 waveform, then refresh
+  static const uint8_t UpdatePartial = 0xFF; // Load the temperature and mode 2 waveform, then refresh
+  static const uint8_t UpdateLoaded = 0xC7;  // Refresh in mode 1 with the waveform already loaded
+  static const uint8_t LoadTemperature = 0xB1;
+  static const uint8_t LoadWaveform = 0x91;
+  // The OTP picks its fast waveform for this temperature, 110C in the register's 1/16C steps
+  static const uint16_t FastWaveformTemperature = 110 * 16;
+  // Below this the fast waveform leaves the panel washed out, so it falls back to the standard one
+  static constexpr double FastMinTemperature = 10.0;
+  // RAM reads are only specified up to a few MHz, so calibration reads back slowly
+  static const uint32_t ReadBackSpeedHz = 1000000;
+  // How long a loaded fast waveform is trusted before the temperature is measured again
+  static constexpr auto FastWaveformLifetime = std::chrono::minutes(10);
   void reset();
+  // Set up the registers, with the RAM window at window (x and width in whole bytes)
+  void configure(const BoundingBox& window, uint8_t updateSequence);
+  // Run an update sequence that doesn't touch the glass and wait for it
+  void runSequence(uint8_t updateSequence);
+  // Load the fast waveform unless it is still loaded, false if it's too cold for it
+  bool loadFastWaveform();
   void waitForBusy(int timeoutMs = 5000);
+  // Refreshes of the three color panels run far longer than the other operations
+  static const int RefreshTimeoutMs = 30000;
+  bool fastWaveformLoaded_ = false;
+  std::chrono::steady_clock::time_point fastWaveformTime_;
+  // The second RAM plane holds this color, if the panel has one
+  bool hasAccent_ = false;
+  IndexedColor accent_ = 0;
+  // Part of ALTRAM that may not match the glass, empty once it all does. Full refreshes leave
+  // all of it unknown, and each partial refresh leaves its window holding the old image.
+  BoundingBox altRamStale_;
+  // Copy a byte aligned window out of a full plane
+  std::vector<uint8_t> copyWindow(std::span<const uint8_t> plane, const BoundingBox& window) const;
+  // Point RAM at a byte aligned window and write it
+  void writeWindow(InkyCommand ram, const BoundingBox& window, std::span<const uint8_t> bytes);
+  protected:
+  virtual void preparePlanes(std::vector<std::vector<uint8_t>>& planes) const override;
+  virtual void packRow(int y, const IndexedColor* row, std::vector<std::vector<uint8_t>>& planes) const override;
+  virtual void unpack(const std::vector<std::span<const uint8_t>>& planes, Image& img) const override;
+  virtual void transmit(const std::vector<std::span<const uint8_t>>& planes) override;
+  virtual bool testSpiClock(uint32_t hz) override;
+  virtual bool canRefreshPartially() const override;
+  virtual bool transmitPartial(const std::vector<std::span<const uint8_t>>& planes, const BoundingBox& region, bool force) override;
+  virtual void finishRefresh() override;
   public:
   InkySSD1683(DisplayInfo info);
-  virtual void show(ShowOperation op) override;
+  virtual ~InkySSD1683();
 };
 
 InkySSD1683::InkySSD1683(DisplayInfo info) : InkyBase(info, SPIDeviceSpeedHz)
@@ -410,6 +1381,24 @@ InkySSD1683::InkySSD1683(DisplayInfo info) : InkyBase(info, SPIDeviceSpeedHz)
   gpio_.setupLine(InkyGpioPin::RESET_PIN, Gpio::LineMode::Output);
   gpio_.write(InkyGpioPin::RESET_PIN, true);
   gpio_.setupLine(InkyGpioPin::BUSY_PIN, Gpio::LineMode::Input);
+  subscribeBusy();
+
+  if (info_.colorCapability == ColorCapability::BlackWhiteRed)
+  {
+    hasAccent_ = true;
+    accent_ = colorMap_.toIndexedColor(ColorName::Red);
+  }
+  else if (info_.colorCapability == ColorCapability::BlackWhiteYellow)
+  {
+    hasAccent_ = true;
+    accent_ = colorMap_.toIndexedColor(ColorName::Yellow);
+  }
+  packFrames();
+}
+
+InkySSD1683::~InkySSD1683()
+{
+  stopWorker();
 }
 
 void InkySSD1683::reset()
@@ -422,104 +1411,299 @@ void InkySSD1683::reset()
   sendCommand(InkyCommand::SSD1683_SW_RESET);
   sleep(1000);
   waitForBusy();
+  registers_.clear();
+  fastWaveformLoaded_ = false;
 }
 
 void InkySSD1683::waitForBusy(int timeoutMs)
 {
-  int i = 0;
-  while (gpio_.read(InkyGpioPin::BUSY_PIN) != 0)
+  // BUSY is high while the controller is working
+  waitForBusyRelease(1, timeoutMs);
+}
+
+void InkySSD1683::preparePlanes(std::vector<std::vector<uint8_t>>& planes) const
+{
+  // 1 bit per pixel, MSB first, each row padded to whole bytes like the panel RAM.
+  // Plane 0 is set where the pixel is white, plane 1 where it is the accent color.
+  size_t planeSize = (size_t)((info_.width + 7) / 8) * info_.height;
+  planes.resize(2);
+  planes[0].resize(planeSize);
+  planes[1].resize(hasAccent_ ? planeSize : 0);
+}
+
+void InkySSD1683::packRow(int y, const IndexedColor* row, std::vector<std::vector<uint8_t>>& planes) const
+{
+  int rowBytes = (info_.width + 7) / 8;
+  packRowBits(row, info_.width,
+              colorMap_.toIndexedColor(ColorName::White), planes[0].data() + y * rowBytes,
+              accent_, hasAccent_ ? planes[1].data() + y * rowBytes : nullptr);
+}
+
+void InkySSD1683::unpack(const std::vector<std::span<const uint8_t>>& planes, Image& img) const
+{
+  // The accent plane wins over the white plane, anything in neither is black
+  IndexedColor white = colorMap_.toIndexedColor(ColorName::White);
+  IndexedColor black = colorMap_.toIndexedColor(ColorName::Black);
+  int rowBytes = (info_.width + 7) / 8;
+  IndexedColor* data = img.data();
+  for (int y = 0; y < info_.height; ++y)
   {
-    sleep(10);
-    ++i;
-    if (i*10 > timeoutMs)
+    for (int x = 0; x < info_.width; ++x)
     {
-      throw std::runtime_error("Timed out while wating for display to finish an operation.");
+      size_t byte = y * rowBytes + x / 8;
+      uint8_t bit = 0x80 >> (x % 8);
+      IndexedColor color = black;
+      if (hasAccent_ && byte < planes[1].size() && (planes[1][byte] & bit))
+      {
+        color = accent_;
+      }
+      else if (byte < planes[0].size() && (planes[0][byte] & bit))
+      {
+        color = white;
+      }
+      data[x + y * info_.width] = color;
     }
   }
 }
 
-void InkySSD1683::show(ShowOperation op)
+void InkySSD1683::configure(const BoundingBox& window, uint8_t updateSequence)
 {
-  std::lock_guard lock(mutex_);
-
-  reset();
-
-  sendCommand(InkyCommand::SSD1683_DRIVER_CONTROL, (uint8_t[]){(uint8_t)(info_.height - 1), (uint8_t)((info_.height - 1) >> 8), 0x00});
-  // Set dummy line period
-  sendCommand(InkyCommand::SSD1683_WRITE_DUMMY, uint8_t{0x1B});
-  // Set Line Width
-  sendCommand(InkyCommand::SSD1683_WRITE_GATELINE, uint8_t{0x0B});
-  // Data entry squence (scan direction leftward and downward)
-  sendCommand(InkyCommand::SSD1683_DATA_MODE, uint8_t{0x03});
-  // Set ram X start and end position
-  sendCommand(InkyCommand::SSD1683_SET_RAMXPOS, (uint8_t[]){(uint8_t)0x00, (uint8_t)((info_.width / 8) - 1)});
-  // Set ram Y start and end position
-  sendCommand(InkyCommand::SSD1683_SET_RAMYPOS, (uint8_t[]){0x00, 0x00, (uint8_t)(info_.height - 1), (uint8_t)((info_.height - 1) >> 8)});
-  // VCOM Voltage
-  sendCommand(InkyCommand::SSD1683_WRITE_VCOM, uint8_t{0x70});
-  // Write LUT DATA
-  // sendCommand(InkyCommand::WRITE_LUT, self._luts[self.lut])
+  int yEnd = window.y + window.height - 1;
+  const RegisterWrite registers[] =
+  {
+    {InkyCommand::SSD1683_DRIVER_CONTROL, {(uint8_t)(info_.height - 1), (uint8_t)((info_.height - 1) >> 8), 0x00}},
+    // Set dummy line period
+    {InkyCommand::SSD1683_WRITE_DUMMY, {0x1B}},
+    // Set Line Width
+    {InkyCommand::SSD1683_WRITE_GATELINE, {0x0B}},
+    // Data entry squence (scan direction leftward and downward)
+    {InkyCommand::SSD1683_DATA_MODE, {0x03}},
+    // Set ram X start and end position
+    {InkyCommand::SSD1683_SET_RAMXPOS, {(uint8_t)(window.x / 8), (uint8_t)((window.x + window.width) / 8 - 1)}},
+    // Set ram Y start and end position
+    {InkyCommand::SSD1683_SET_RAMYPOS, {(uint8_t)window.y, (uint8_t)(window.y >> 8), (uint8_t)yEnd, (uint8_t)(yEnd >> 8)}},
+    // Display mode 1 drives every pixel, mode 2 only those that differ between RAM (new) and
+    // ALTRAM (old)
+    {InkyCommand::SSD1683_DISP_CTRL2, {updateSequence}},
+    // VCOM Voltage
+    {InkyCommand::SSD1683_WRITE_VCOM, {0x70}},
+    // The waveforms come from OTP, picked by display mode and temperature, see loadFastWaveform
+  };
+  writeRegisters(registers);
 
-  if (border_ == colorMap_.toIndexedColor(ColorName::Black))
+  if (frontBorder_ == colorMap_.toIndexedColor(ColorName::Black))
   {
-    sendCommand(InkyCommand::SSD1683_WRITE_BORDER, uint8_t{0b00000000});
+    writeRegister(InkyCommand::SSD1683_WRITE_BORDER, uint8_t{0b00000000});
     // GS Transition + Waveform 00 + GSA 0 + GSB 0
   }  
-  else if (border_ == colorMap_.toIndexedColor(ColorName::Red))
+  else if (frontBorder_ == colorMap_.toIndexedColor(ColorName::Red))
   {
-    sendCommand(InkyCommand::SSD1683_WRITE_BORDER, uint8_t{0b00000110});
+    writeRegister(InkyCommand::SSD1683_WRITE_BORDER, uint8_t{0b00000110});
     // GS Transition + Waveform 01 + GSA 1 + GSB 0
   }
-  else if (border_ == colorMap_.toIndexedColor(ColorName::Yellow))
+  else if (frontBorder_ == colorMap_.toIndexedColor(ColorName::Yellow))
   {
-    sendCommand(InkyCommand::SSD1683_WRITE_BORDER, uint8_t{0b00001111});
+    writeRegister(InkyCommand::SSD1683_WRITE_BORDER, uint8_t{0b00001111});
     // GS Transition + Waveform 11 + GSA 1 + GSB 1
   }
-  else if (border_ == colorMap_.toIndexedColor(ColorName::White))
+  else if (frontBorder_ == colorMap_.toIndexedColor(ColorName::White))
   {
-    sendCommand(InkyCommand::SSD1683_WRITE_BORDER, uint8_t{0b00000001});
+    writeRegister(InkyCommand::SSD1683_WRITE_BORDER, uint8_t{0b00000001});
     // GS Transition + Waveform 00 + GSA 0 + GSB 1
   }
+}
+
+void InkySSD1683::transmit(const std::vector<std::span<const uint8_t>>& planes)
+{
+  // The controller keeps its registers between refreshes, so once it has been reset
+  // only the registers that changed (e.g. the border) get written again.
+  // Every refresh powers the panel up and back down by itself, so there is nothing to wake.
+  if (session_ == SessionState::NeedsHardReset)
+  {
+    beginPhase(ShowPhase::Reset);
+    reset();
+  }
+  else
+  {
+    beginPhase(ShowPhase::Refresh);
+    finishRefresh();
+  }
+  beginPhase(ShowPhase::Configure);
+  uint8_t updateSequence = UpdateFull;
+  if (frontRefreshMode_ == RefreshMode::Fast && !hasAccent_ && loadFastWaveform())
+  {
+    updateSequence = UpdateLoaded;
+  }
+  else
+  {
+    // The full sequence loads the standard waveform over the fast one
+    fastWaveformLoaded_ = false;
+  }
+  configure({.x = 0, .y = 0, .width = info_.width, .height = info_.height}, updateSequence);
+  session_ = SessionState::Initialized;
+  // ALTRAM holds the accent plane, or on black and white panels whatever was in it before,
+  // so none of it can be trusted to match the glass
+  altRamStale_ = {.x = 0, .y = 0, .width = (info_.width + 7) / 8 * 8, .height = info_.height};
 
   // Set RAM address to 0, 0
+  beginPhase(ShowPhase::Transfer);
   sendCommand(InkyCommand::SSD1683_SET_RAMXCOUNT, uint8_t{0x00});
   sendCommand(InkyCommand::SSD1683_SET_RAMYCOUNT, (uint8_t[2]){0x00, 0x00});
 
   // Write the images to display RAM
-  if (op == ShowOperation::BufferedImage)
+  sendCommand(InkyCommand::SSD1683_WRITE_RAM, planes[0]);
+  sendCommand(InkyCommand::SSD1683_WRITE_ALTRAM, planes[1]);
+
+  waitForBusy();
+  // The refresh runs on after this returns, finishRefresh waits for it
+  beginPhase(ShowPhase::Refresh);
+  sendCommand(InkyCommand::SSD1683_MASTER_ACTIVATE);
+}
+
+void InkySSD1683::finishRefresh()
+{
+  // The refresh runs on after transmit returns. Without a session there's none running.
+  if (session_ == SessionState::Initialized)
   {
-    generatePackedPlane(buf_, whitePlane, colorMap_.toIndexedColor(ColorName::White));
-    
-    if (info_.colorCapability == ColorCapability::BlackWhiteRed)
-    {
-      generatePackedPlane(buf_, colorPlane, colorMap_.toIndexedColor(ColorName::Red));
-    }
-    else if (info_.colorCapability == ColorCapability::BlackWhiteYellow)
-    {
-      generatePackedPlane(buf_, colorPlane, colorMap_.toIndexedColor(ColorName::Yellow));
-      
-    }
+    waitForBusy(RefreshTimeoutMs);
+  }
+}
+
+void InkySSD1683::runSequence(uint8_t updateSequence)
+{
+  writeRegister(InkyCommand::SSD1683_DISP_CTRL2, updateSequence);
+  sendCommand(InkyCommand::SSD1683_MASTER_ACTIVATE);
+  waitForBusy();
+}
+
+bool InkySSD1683::loadFastWaveform()
+{
+  auto now = std::chrono::steady_clock::now();
+  if (fastWaveformLoaded_ && now - fastWaveformTime_ < FastWaveformLifetime)
+  {
+    return true;
   }
-  else if (op == ShowOperation::ColorTest)
+  fastWaveformLoaded_ = false;
+
+  // Measure with the internal sensor. The register holds 1/16C steps in its top 12 bits.
+  runSequence(LoadTemperature);
+  uint8_t reading[2] = {};
+  readCommand(InkyCommand::SSD1683_TEMP_READ, reading);
+  double temperature = (int16_t)((reading[0] << 8) | reading[1]) / 256.0;
+  if (temperature < FastMinTemperature)
   {
-    Image colorTest = generateColorTest();
-    generatePackedPlane(colorTest, whitePlane, colorMap_.toIndexedColor(ColorName::White));
+    return false;
+  }
 
-    if (info_.colorCapability == ColorCapability::BlackWhiteRed)
-    {
-      generatePackedPlane(colorTest, colorPlane, colorMap_.toIndexedColor(ColorName::Red));
-    }
-    else if (info_.colorCapability == ColorCapability::BlackWhiteYellow)
-    {
-      generatePackedPlane(colorTest, colorPlane, colorMap_.toIndexedColor(ColorName::Yellow));
-    }
+  // Claim it's hot, so loading the mode 1 waveform picks the short one
+  sendCommand(InkyCommand::SSD1683_TEMP_WRITE, (uint8_t[]){(uint8_t)(FastWaveformTemperature >> 4), (uint8_t)(FastWaveformTemperature << 4)});
+  runSequence(LoadWaveform);
+  fastWaveformLoaded_ = true;
+  fastWaveformTime_ = now;
+  return true;
+}
+
+bool InkySSD1683::testSpiClock(uint32_t hz)
+{
+  if (session_ == SessionState::NeedsHardReset)
+  {
+    reset();
+    session_ = SessionState::Initialized;
   }
-  
-  sendCommand(InkyCommand::SSD1683_WRITE_RAM, whitePlane);
-  sendCommand(InkyCommand::SSD1683_WRITE_ALTRAM, colorPlane);
+  else
+  {
+    finishRefresh();
+  }
+  configure({.x = 0, .y = 0, .width = info_.width, .height = info_.height}, UpdateFull);
+
+  // Noise, so a stuck or unconnected read line can't pass
+  std::vector<uint8_t> pattern((size_t)((info_.width + 7) / 8) * info_.height);
+  std::mt19937 rng(hz);
+  std::generate(pattern.begin(), pattern.end(), [&]{ return (uint8_t)rng(); });
+
+  spi_.setBusSpeed(hz);
+  sendCommand(InkyCommand::SSD1683_SET_RAMXCOUNT, uint8_t{0x00});
+  sendCommand(InkyCommand::SSD1683_SET_RAMYCOUNT, (uint8_t[2]){0x00, 0x00});
+  sendCommand(InkyCommand::SSD1683_WRITE_RAM, pattern);
+
+  // Read back the black/white RAM. The first byte out is a dummy.
+  spi_.setBusSpeed(ReadBackSpeedHz);
+  writeRegister(InkyCommand::SSD1683_READ_RAM_OPTION, uint8_t{0x00});
+  sendCommand(InkyCommand::SSD1683_SET_RAMXCOUNT, uint8_t{0x00});
+  sendCommand(InkyCommand::SSD1683_SET_RAMYCOUNT, (uint8_t[2]){0x00, 0x00});
+  std::vector<uint8_t> readBack(pattern.size() + 1);
+  readCommand(InkyCommand::SSD1683_READ_RAM, readBack);
+  return std::equal(pattern.begin(), pattern.end(), readBack.begin() + 1);
+}
+
+bool InkySSD1683::canRefreshPartially() const
+{
+  // ALTRAM holds the old frame during a partial refresh, so it can't hold the accent plane too
+  return !hasAccent_;
+}
+
+std::vector<uint8_t> InkySSD1683::copyWindow(std::span<const uint8_t> plane, const BoundingBox& window) const
+{
+  int rowBytes = (info_.width + 7) / 8;
+  int windowRowBytes = window.width / 8;
+  std::vector<uint8_t> bytes((size_t)windowRowBytes * window.height);
+  for (int y = 0; y < window.height; ++y)
+  {
+    std::copy_n(plane.begin() + (size_t)(window.y + y) * rowBytes + window.x / 8, windowRowBytes, bytes.begin() + (size_t)y * windowRowBytes);
+  }
+  return bytes;
+}
+
+void InkySSD1683::writeWindow(InkyCommand ram, const BoundingBox& window, std::span<const uint8_t> bytes)
+{
+  // The write starts at the window origin, and the counters wrap within the window
+  configure(window, UpdatePartial);
+  sendCommand(InkyCommand::SSD1683_SET_RAMXCOUNT, (uint8_t)(window.x / 8));
+  sendCommand(InkyCommand::SSD1683_SET_RAMYCOUNT, (uint8_t[2]){(uint8_t)window.y, (uint8_t)(window.y >> 8)});
+  sendCommand(ram, bytes);
+}
+
+bool InkySSD1683::transmitPartial(const std::vector<std::span<const uint8_t>>& planes, const BoundingBox& region, bool force)
+{
+  // RAM is addressed in whole bytes of 8 pixels across, so widen the window to byte edges
+  int xStart = region.x / 8;
+  int xEnd = (region.x + region.width + 7) / 8;
+  BoundingBox window {.x = xStart * 8, .y = region.y, .width = (xEnd - xStart) * 8, .height = region.height};
+
+  std::vector<uint8_t>& shown = shownPlanes_[0];
+  std::vector<uint8_t> newWindow = copyWindow(planes[0], window);
+  if (!force && newWindow == copyWindow(shown, window))
+  {
+    return false;
+  }
+
+  beginPhase(ShowPhase::Refresh);
+  finishRefresh();
+  beginPhase(ShowPhase::Configure);
+  configure(window, UpdatePartial);
+  fastWaveformLoaded_ = false;
+
+  // Mode 2 drives every pixel where RAM and ALTRAM differ, not only those in the window, so
+  // ALTRAM has to match the glass everywhere first. RAM already does.
+  beginPhase(ShowPhase::Transfer);
+  if (!altRamStale_.empty())
+  {
+    writeWindow(InkyCommand::SSD1683_WRITE_ALTRAM, altRamStale_, copyWindow(shown, altRamStale_));
+  }
+  writeWindow(InkyCommand::SSD1683_WRITE_RAM, window, newWindow);
 
   waitForBusy();
+  beginPhase(ShowPhase::Refresh);
   sendCommand(InkyCommand::SSD1683_MASTER_ACTIVATE);
+
+  // ALTRAM still has the old window, so the next partial refresh brings it up to date
+  altRamStale_ = window;
+  int rowBytes = (info_.width + 7) / 8;
+  for (int y = 0; y < window.height; ++y)
+  {
+    std::copy_n(newWindow.begin() + (size_t)y * (xEnd - xStart), xEnd - xStart, shown.begin() + (size_t)(window.y + y) * rowBytes + xStart);
+  }
+  return true;
 }
 
 class InkyUC8159 final : public InkyBase
@@ -538,12 +1722,18 @@ class InkyUC8159 final : public InkyBase
   static const uint32_t DefaultSPITransferSize = 4096;
   static const SPIMode DefaultSPIMode = SPIMode::SPI_MODE_0; //SPIMode::SPI_NO_CS;
   CorrectionData correctionData;
-  std::vector<uint8_t> packed;
   void reset();
+  void configure();
   void waitForBusy(int timeoutMs = 40000);
+  protected:
+  virtual void preparePlanes(std::vector<std::vector<uint8_t>>& planes) const override;
+  virtual void packRow(int y, const IndexedColor* row, std::vector<std::vector<uint8_t>>& planes) const override;
+  virtual void unpack(const std::vector<std::span<const uint8_t>>& planes, Image& img) const override;
+  virtual void transmit(const std::vector<std::span<const uint8_t>>& planes) override;
+  virtual IndexedColor cleanColor() const override;
   public:
   InkyUC8159(DisplayInfo info);
-  virtual void show(ShowOperation op) override;
+  virtual ~InkyUC8159();
 };
 
 InkyUC8159::InkyUC8159(DisplayInfo info) : InkyBase(info, DefaultSPIDeviceSpeedHz, DefaultSPITransferSize, DefaultSPIMode)
@@ -575,7 +1765,7 @@ InkyUC8159::InkyUC8159(DisplayInfo info) : InkyBase(info, DefaultSPIDeviceSpeedH
   // Correct the eeprom and buffer sizes
   info_.width = correctionData.cols;
   info_.height = correctionData.rows;
-  buf_ = Image(info_.width, info_.height, colorMap_);
+  packFrames();
 
   // Setup the GPIO pins
   gpio_.setupLine(InkyGpioPin::DC_PIN, Gpio::LineMode::Output);
@@ -583,6 +1773,12 @@ InkyUC8159::InkyUC8159(DisplayInfo info) : InkyBase(info, DefaultSPIDeviceSpeedH
   gpio_.setupLine(InkyGpioPin::RESET_PIN, Gpio::LineMode::Output);
   gpio_.write(InkyGpioPin::RESET_PIN, true);
   gpio_.setupLine(InkyGpioPin::BUSY_PIN, Gpio::LineMode::Input);
+  subscribeBusy();
+}
+
+InkyUC8159::~InkyUC8159()
+{
+  stopWorker();
 }
 
 void InkyUC8159::reset()
@@ -592,10 +1788,16 @@ void InkyUC8159::reset()
     gpio_.write(InkyGpioPin::RESET_PIN, true);
 
     waitForBusy(1000);
+    registers_.clear();
+}
 
+void InkyUC8159::configure()
+{
+  const RegisterWrite registers[] =
+  {
     // Resolution Setting
     // 10bit horizontal followed by a 10bit vertical resolution
-    sendCommand(InkyCommand::UC8159_TRES, (uint16_t[]){info_.width, info_.height} );
+    {InkyCommand::UC8159_TRES, {(uint8_t)info_.width, (uint8_t)(info_.width >> 8), (uint8_t)info_.height, (uint8_t)(info_.height >> 8)}},
 
     // Panel Setting
     // 0b11000000 = Resolution select, 0b00 = 640x480, our panel is 0b11 = 600x448
@@ -607,14 +1809,14 @@ void InkyUC8159::reset()
     // 0b00000001 = Soft reset, 0 = Reset, 1 = Normal (Default)
     // 0b11 = 600x448
     // 0b10 = 640x400
-    sendCommand(InkyCommand::UC8159_PSR, (uint8_t[])
+    {InkyCommand::UC8159_PSR,
     {
         (uint8_t)(correctionData.resolutionSetting | 0b00101111),  // See above for more magic numbers
         0x08                                                       // display_colours == UC8159_7C
-    });
+    }},
 
     // Power Settings
-    sendCommand(InkyCommand::UC8159_PWR, (uint8_t[])
+    {InkyCommand::UC8159_PWR,
     {
         (0x06 << 3) |  // ??? - not documented in UC8159 datasheet  # noqa: W504
         (0x01 << 2) |  // SOURCE_INTERNAL_DC_DC                     # noqa: W504
@@ -623,7 +1825,7 @@ void InkyUC8159::reset()
         0x00,          // VGx_20V
         0x23,          // UC8159_7C
         0x23           // UC8159_7C
-    });
+    }},
 
     // Set the PLL clock frequency to 50Hz
     // 0b11000000 = Ignore
@@ -632,91 +1834,99 @@ void InkyUC8159::reset()
     // PLL = 2MHz * (M / N)
     // PLL = 2MHz * (7 / 4)
     // PLL = 2,800,000 ???
-    sendCommand(InkyCommand::UC8159_PLL, (uint8_t)0x3C);  // 0b00111100
+    {InkyCommand::UC8159_PLL, {0x3C}},  // 0b00111100
 
     // Send the TSE register to the display
-    sendCommand(InkyCommand::UC8159_TSE, (uint8_t)0x00);  // Colour
+    {InkyCommand::UC8159_TSE, {0x00}},  // Colour
 
     // VCOM and Data Interval setting
     // 0b11100000 = Vborder control (0b001 = LUTB voltage)
     // 0b00010000 = Data polarity
     // 0b00001111 = Vcom and data interval (0b0111 = 10, default)
-    sendCommand(InkyCommand::UC8159_CDI, (uint8_t)((border_ << 5) | 0x17));  // 0b00110111
+    {InkyCommand::UC8159_CDI, {(uint8_t)((frontBorder_ << 5) | 0x17)}},  // 0b00110111
 
     // Gate/Source non-overlap period
     // 0b11110000 = Source to Gate (0b0010 = 12nS, default)
     // 0b00001111 = Gate to Source
-    sendCommand(InkyCommand::UC8159_TCON, (uint8_t)0x22);  // 0b00100010
+    {InkyCommand::UC8159_TCON, {0x22}},  // 0b00100010
 
     // Disable external flash
-    sendCommand(InkyCommand::UC8159_DAM, (uint8_t)0x00);
+    {InkyCommand::UC8159_DAM, {0x00}},
 
     // UC8159_7C
-    sendCommand(InkyCommand::UC8159_PWS, (uint8_t)0xAA);
+    {InkyCommand::UC8159_PWS, {0xAA}},
 
     // Power off sequence
     // 0b00110000 = power off sequence of VDH and VDL, 0b00 = 1 frame (default)
     // All other bits ignored?
-    sendCommand(InkyCommand::UC8159_PFS, (uint8_t)0x00);  // PFS_1_FRAME
+    {InkyCommand::UC8159_PFS, {0x00}},  // PFS_1_FRAME
+  };
+  writeRegisters(registers);
 }
 
 void InkyUC8159::waitForBusy(int timeoutMs)
 {
-  // If the busy_pin is *high* (pulled up by host)
-  // then assume we're not getting a signal from inky
-  // and wait the timeout period to be safe.
-  if (gpio_.read(InkyGpioPin::BUSY_PIN) == 1)
-  {
-    sleep(timeoutMs);
-    return;
-  }
+  // BUSY is low while the controller is working, but it can take a moment to
+  // go low after a command. Until BUSY has been seen low at least once the line
+  // might not be connected, so in that case allow the whole timeout for it to
+  // assert instead of trusting a high reading.
+  static const int AssertGraceMs = 50;
+  waitForBusyRelease(0, timeoutMs, busySeen() ? AssertGraceMs : timeoutMs);
+}
 
-  int i = 0;
-  while (gpio_.read(InkyGpioPin::BUSY_PIN) == 0)
-  {
-    sleep(10);
-    ++i;
-    if (i*10 > timeoutMs)
-    {
-      throw std::runtime_error("Timed out while wating for display to finish an operation.");
-    }
-  }
+void InkyUC8159::preparePlanes(std::vector<std::vector<uint8_t>>& planes) const
+{
+  planes.resize(1);
+  planes[0].resize(((size_t)info_.width * info_.height + 1) / 2);
 }
 
-void InkyUC8159::show(ShowOperation op)
+void InkyUC8159::packRow(int y, const IndexedColor* row, std::vector<std::vector<uint8_t>>& planes) const
 {
-  std::lock_guard lock(mutex_);
+  packNibbleRow(y, row, info_.width, planes[0]);
+}
 
-  if (op == ShowOperation::BufferedImage)
-  {
-    generatePackedIndex(buf_, packed);
-  }
-  else if (op == ShowOperation::ColorTest)
-  {
-    generatePackedIndex(generateColorTest(), packed);
-  }
-  else if (op == ShowOperation::CleanDisplay)
+void InkyUC8159::unpack(const std::vector<std::span<const uint8_t>>& planes, Image& img) const
+{
+  unpackNibbles(planes[0], img);
+}
+
+IndexedColor InkyUC8159::cleanColor() const
+{
+  // Index 7 isn't a real color, it drives every pixel to a neutral state
+  return 7;
+}
+
+void InkyUC8159::transmit(const std::vector<std::span<const uint8_t>>& planes)
+{
+  // Powering off keeps the registers, so after the first refresh only the ones
+  // that changed (e.g. the border in CDI) are written and waking is just PON
+  if (session_ == SessionState::NeedsHardReset)
   {
-    Image cleanImage(info_.width, info_.height, colorMap_);
-    for (int i=0; i < info_.width*info_.height; ++i)
-    {
-      cleanImage.data()[i] = (uint8_t)7;
-    }
-    generatePackedIndex(cleanImage, packed);
+    beginPhase(ShowPhase::Reset);
+    reset();
+    session_ = SessionState::Sleeping;
   }
+  beginPhase(ShowPhase::Configure);
+  configure();
 
-  reset();
-
-  sendCommand(InkyCommand::UC8159_DTM1, packed);
+  beginPhase(ShowPhase::Transfer);
+  sendCommand(InkyCommand::UC8159_DTM1, planes[0]);
 
-  sendCommand(InkyCommand::UC8159_PON);
-  waitForBusy(200);
+  beginPhase(ShowPhase::Refresh);
+  if (session_ == SessionState::Sleeping)
+  {
+    sendCommand(InkyCommand::UC8159_PON);
+    waitForBusy(200);
+    session_ = SessionState::Initialized;
+  }
 
   sendCommand(InkyCommand::UC8159_DRF);
   waitForBusy(32000);
 
+  beginPhase(ShowPhase::PowerOff);
   sendCommand(InkyCommand::UC8159_POF);
   waitForBusy(200);
+  session_ = SessionState::Sleeping;
 }
 
 static uint16_t read16(const uint8_t* buf)
@@ -0,0 +1,201 @@
+// Hack to fix intellisense with some arm NEON code
+#if __INTELLISENSE__
+#undef __ARM_NEON
+#undef __ARM_NEON__
+#endif
+
+#include "PackBits.hpp"
+
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Each kernel packs whole bytes from x while it can and returns where it stopped, which is
+// always a multiple of 8. packBytesScalar finishes the row, including the partial last byte.
+
+static int packBytesScalar(const IndexedColor* row, int x, int width, IndexedColor colorA, uint8_t* outA, IndexedColor colorB, uint8_t* outB)
+{
+  for (; x < width; x += 8)
+  {
+    uint8_t bitsA = 0;
+    uint8_t bitsB = 0;
+    for (int bit = 0; bit < 8 && x + bit < width; ++bit)
+    {
+      bitsA |= (row[x + bit] == colorA) ? (uint8_t)(0x80 >> bit) : (uint8_t)0;
+      bitsB |= (row[x + bit] == colorB) ? (uint8_t)(0x80 >> bit) : (uint8_t)0;
+    }
+    outA[x / 8] = bitsA;
+    if (outB)
+    {
+      outB[x / 8] = bitsB;
+    }
+  }
+  return x;
+}
+
+// SWAR: one byte with bit 7 for the first of 8 pixels, set where that pixel equals color
+static inline uint8_t packEqualBits(uint64_t pixels, uint8_t color)
+{
+  // Zero bytes where the pixel matches, then flag each zero byte in its high bit without cross-byte carries
+  uint64_t x = pixels ^ (0x0101010101010101ull * color);
+  uint64_t nonZero = ((x & 0x7F7F7F7F7F7F7F7Full) + 0x7F7F7F7F7F7F7F7Full) | x;
+  uint64_t equal = (~nonZero & 0x8080808080808080ull) >> 7;
+  // Multiply gathers byte k of equal in to bit 63-k
+  return (uint8_t)((equal * 0x8040201008040201ull) >> 56);
+}
+
+static int packBytesSwar(const IndexedColor* row, int x, int width, IndexedColor colorA, uint8_t* outA, IndexedColor colorB, uint8_t* outB)
+{
+  for (; x + 8 <= width; x += 8)
+  {
+    uint64_t pixels;
+    std::memcpy(&pixels, row + x, sizeof(pixels));
+    outA[x / 8] = packEqualBits(pixels, colorA);
+    if (outB)
+    {
+      outB[x / 8] = packEqualBits(pixels, colorB);
+    }
+  }
+  return x;
+}
+
+#if defined(__SSE2__)
+// Reverses the bit order of a byte, movemask results are LSB first but the panels want MSB first
+static constexpr std::array<uint8_t, 256> ReverseBits = []
+{
+  std::array<uint8_t, 256> table {};
+  for (int i = 0; i < 256; ++i)
+  {
+    for (int bit = 0; bit < 8; ++bit)
+    {
+      if (i & (1 << bit))
+      {
+        table[i] |= (uint8_t)(0x80 >> bit);
+      }
+    }
+  }
+  return table;
+}();
+
+static int packBytesSse2(const IndexedColor* row, int x, int width, IndexedColor colorA, uint8_t* outA, IndexedColor colorB, uint8_t* outB)
+{
+  const __m128i matchA = _mm_set1_epi8((char)colorA);
+  const __m128i matchB = _mm_set1_epi8((char)colorB);
+  for (; x + 16 <= width; x += 16)
+  {
+    __m128i pixels = _mm_loadu_si128((const __m128i*)(row + x));
+    int bitsA = _mm_movemask_epi8(_mm_cmpeq_epi8(pixels, matchA));
+    outA[x / 8] = ReverseBits[bitsA & 0xFF];
+    outA[x / 8 + 1] = ReverseBits[bitsA >> 8];
+    if (outB)
+    {
+      int bitsB = _mm_movemask_epi8(_mm_cmpeq_epi8(pixels, matchB));
+      outB[x / 8] = ReverseBits[bitsB & 0xFF];
+      outB[x / 8 + 1] = ReverseBits[bitsB >> 8];
+    }
+  }
+  return x;
+}
+#endif
+
+#if defined(__ARM_NEON)
+static int packBytesNeon(const IndexedColor* row, int x, int width, IndexedColor colorA, uint8_t* outA, IndexedColor colorB, uint8_t* outB)
+{
+  // Give each matching lane its bit weight, then three pairwise adds narrow 8 lanes to one byte
+  static const uint8_t weights[16] = {128, 64, 32, 16, 8, 4, 2, 1, 128, 64, 32, 16, 8, 4, 2, 1};
+  const uint8x16_t bitWeights = vld1q_u8(weights);
+  const uint8x16_t matchA = vdupq_n_u8(colorA);
+  const uint8x16_t matchB = vdupq_n_u8(colorB);
+  auto narrow = [](uint8x16_t bits)
+  {
+    uint8x8_t sum = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+    sum = vpadd_u8(sum, sum);
+    return vpadd_u8(sum, sum);
+  };
+  for (; x + 16 <= width; x += 16)
+  {
+    uint8x16_t pixels = vld1q_u8(row + x);
+    uint8x8_t bitsA = narrow(vandq_u8(vceqq_u8(pixels, matchA), bitWeights));
+    outA[x / 8] = vget_lane_u8(bitsA, 0);
+    outA[x / 8 + 1] = vget_lane_u8(bitsA, 1);
+    if (outB)
+    {
+      uint8x8_t bitsB = narrow(vandq_u8(vceqq_u8(pixels, matchB), bitWeights));
+      outB[x / 8] = vget_lane_u8(bitsB, 0);
+      outB[x / 8 + 1] = vget_lane_u8(bitsB, 1);
+    }
+  }
+  return x;
+}
+#endif
+
+bool packBitsKernelAvailable(PackBitsKernel kernel)
+{
+  switch (kernel)
+  {
+    case PackBitsKernel::Scalar:
+    case PackBitsKernel::Swar:
+      return true;
+    case PackBitsKernel::Sse2:
+#if defined(__SSE2__)
+      return true;
+#else
+      return false;
+#endif
+    case PackBitsKernel::Neon:
+#if defined(__ARM_NEON)
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+void packRowBits(PackBitsKernel kernel, const IndexedColor* row, int width, IndexedColor colorA, uint8_t* outA, IndexedColor colorB, uint8_t* outB)
+{
+  int x = 0;
+  switch (kernel)
+  {
+    case PackBitsKernel::Scalar:
+      break;
+    case PackBitsKernel::Swar:
+      x = packBytesSwar(row, x, width, colorA, outA, colorB, outB);
+      break;
+    case PackBitsKernel::Sse2:
+#if defined(__SSE2__)
+      x = packBytesSse2(row, x, width, colorA, outA, colorB, outB);
+      x = packBytesSwar(row, x, width, colorA, outA, colorB, outB);
+      break;
+#else
+      throw std::invalid_argument("This build has no SSE2 bit packing!");
+#endif
+    case PackBitsKernel::Neon:
+#if defined(__ARM_NEON)
+      x = packBytesNeon(row, x, width, colorA, outA, colorB, outB);
+      x = packBytesSwar(row, x, width, colorA, outA, colorB, outB);
+      break;
+#else
+      throw std::invalid_argument("This build has no NEON bit packing!");
+#endif
+  }
+  packBytesScalar(row, x, width, colorA, outA, colorB, outB);
+}
+
+void packRowBits(const IndexedColor* row, int width, IndexedColor colorA, uint8_t* outA, IndexedColor colorB, uint8_t* outB)
+{
+#if defined(__SSE2__)
+  packRowBits(PackBitsKernel::Sse2, row, width, colorA, outA, colorB, outB);
+#elif defined(__ARM_NEON)
+  packRowBits(PackBitsKernel::Neon, row, width, colorA, outA, colorB, outB);
+#else
+  packRowBits(PackBitsKernel::Swar, row, width, colorA, outA, colorB, outB);
+#endif
+}
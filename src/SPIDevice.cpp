@@ -2,6 +2,7 @@
 
 #include <stdexcept>
 #include <algorithm>
+#include <fstream>
 #ifndef SIMULATE_PI_HARDWARE
 #include <stdint.h>
 #include <unistd.h>
@@ -11,13 +12,47 @@
 #include <sys/ioctl.h>
 #include <linux/types.h>
 #include <linux/spi/spidev.h>
+
+// SPI_IOC_MESSAGE encodes the size of the transfer array in the ioctl's 14 bit size field
+static const size_t MaxTransfersPerMessage = ((1 << _IOC_SIZEBITS) - 1) / sizeof(spi_ioc_transfer);
+
+struct SPIDevice::Transfers
+{
+  // The blocks of the message being built, and the bytes they hold
+  std::vector<spi_ioc_transfer> blocks;
+  size_t bytes = 0;
+};
+#else
+struct SPIDevice::Transfers
+{
+};
 #endif
 
+// Size of the spidev buffer, which limits the bytes sent (and received) by a single message
+static size_t ReadSpidevBufferSize()
+{
+  std::ifstream file("/sys/module/spidev/parameters/bufsiz");
+  size_t bufferSize = 0;
+  if (file >> bufferSize && bufferSize > 0)
+  {
+    return bufferSize;
+  }
+  // The module's default
+  return 4096;
+}
+
 SPIDevice::SPIDevice(std::string spiDeviceName, uint32_t maxBusSpeedHz, uint32_t maxTransferSizeBytes, SPIMode spiMode) : 
   spiMode_(spiMode),
   maxBusSpeedHz_(maxBusSpeedHz),
-  maxTransferSizeBytes_(maxTransferSizeBytes)
+  maxTransferSizeBytes_(maxTransferSizeBytes),
+  transfers_(std::make_unique<Transfers>())
 {
+  if (maxTransferSizeBytes_ == 0)
+  {
+    throw std::invalid_argument("SPI transfer size must not be zero");
+  }
+  maxMessageBytes_ = ReadSpidevBufferSize();
+
   #ifndef SIMULATE_PI_HARDWARE
 	spiFile_ = open(spiDeviceName.c_str(), O_RDWR);
 	if (spiFile_ < 0)
@@ -74,63 +109,127 @@ SPIDevice::~SPIDevice()
   #endif
 }
 
-int SPIDevice::write(const std::vector<uint8_t> &buf, uint16_t delayUs)
+void SPIDevice::setBusSpeed(uint32_t busSpeedHz)
 {
-  return write(buf.data(), buf.size(), delayUs);
+  #ifndef SIMULATE_PI_HARDWARE
+  if (ioctl(spiFile_, SPI_IOC_WR_MAX_SPEED_HZ, &busSpeedHz) == -1)
+  {
+    throw std::runtime_error("Failed to write max speed on the spi bus");
+  }
+  #endif
+  maxBusSpeedHz_ = busSpeedHz;
 }
 
-int SPIDevice::read(std::vector<uint8_t> &buf, uint16_t delayUs)
+uint32_t SPIDevice::busSpeed() const
 {
-  return read(buf.data(), buf.size(), delayUs);
+  return maxBusSpeedHz_;
 }
 
-int SPIDevice::write(const uint8_t* buf, size_t len, uint16_t delayUs)
+int SPIDevice::write(const std::vector<uint8_t> &buf, uint16_t delayUs, bool csChange)
 {
-  int ret = 0;
-  #ifndef SIMULATE_PI_HARDWARE
+  return write(buf.data(), buf.size(), delayUs, csChange);
+}
+
+int SPIDevice::read(std::vector<uint8_t> &buf, uint16_t delayUs, bool csChange)
+{
+  return read(buf.data(), buf.size(), delayUs, csChange);
+}
 
-  uint32_t blocks = len / maxTransferSizeBytes_ + ((len % maxTransferSizeBytes_ != 0) ? 1 : 0);
-  std::vector<spi_ioc_transfer> transfers(blocks);
+int SPIDevice::write(const uint8_t* buf, size_t len, uint16_t delayUs, bool csChange)
+{
+  return transfer(buf, nullptr, len, delayUs, csChange);
+}
 
-  for (int i=0; i < blocks; i++)
+int SPIDevice::read(uint8_t* buf, size_t len, uint16_t delayUs, bool csChange)
+{
+  return transfer(nullptr, buf, len, delayUs, csChange);
+}
+
+int SPIDevice::transact(std::span<const SPISegment> segments, const std::function<void(bool)>& setDataCommand, uint16_t delayUs)
+{
+  int ret = 0;
+  for (size_t i = 0; i < segments.size(); ++i)
   {
-    transfers[i] = 
+    // The DC line can't change mid message, so each run is sent before it flips
+    if (i == 0 || segments[i].dataCommand != segments[i-1].dataCommand)
     {
-      .tx_buf = (uint64_t)(buf + i*maxTransferSizeBytes_),
-      .len = std::min(maxTransferSizeBytes_, len - i*maxTransferSizeBytes_),
-      .speed_hz = maxBusSpeedHz_,
-      .delay_usecs = delayUs,
-      .bits_per_word = bitsPerWord_,
-	  };
+      int sent = flush();
+      if (sent < 0)
+      {
+        return -1;
+      }
+      ret += sent;
+      setDataCommand(segments[i].dataCommand);
+    }
+    int sent = queue(segments[i].data.data(), nullptr, segments[i].data.size(), delayUs, false);
+    if (sent < 0)
+    {
+      return -1;
+    }
+    ret += sent;
   }
-  for (int i=0; i < blocks; i++)
+  int sent = flush();
+  return sent < 0 ? -1 : ret + sent;
+}
+
+int SPIDevice::transfer(const uint8_t* tx, uint8_t* rx, size_t len, uint16_t delayUs, bool csChange)
+{
+  int queued = queue(tx, rx, len, delayUs, csChange);
+  if (queued < 0)
   {
-    ret += ioctl(spiFile_, SPI_IOC_MESSAGE(1), &transfers[i]);
+    return -1;
   }
-	
-  #endif
-  return ret;
+  int sent = flush();
+  return sent < 0 ? -1 : queued + sent;
 }
 
-int SPIDevice::read(uint8_t* buf, size_t len, uint16_t delayUs)
+int SPIDevice::queue(const uint8_t* tx, uint8_t* rx, size_t len, uint16_t delayUs, bool csChange)
 {
   int ret = 0;
   #ifndef SIMULATE_PI_HARDWARE
-  uint32_t blocks = len / maxTransferSizeBytes_ + ((len % maxTransferSizeBytes_ != 0) ? 1 : 0);
-  std::vector<spi_ioc_transfer> transfers(blocks);
-
-  for (int i=0; i < blocks; i++)
+  std::vector<spi_ioc_transfer>& blocks = transfers_->blocks;
+  size_t offset = 0;
+  while (offset < len)
   {
-    transfers[i] = 
+    // Send the message once it's as big as spidev takes
+    if (transfers_->bytes >= maxMessageBytes_ || blocks.size() >= MaxTransfersPerMessage)
     {
-      .rx_buf = (uint64_t)(buf + i*maxTransferSizeBytes_),
-      .len = std::min(maxTransferSizeBytes_, len - i*maxTransferSizeBytes_),
+      int sent = flush();
+      if (sent < 0)
+      {
+        return -1;
+      }
+      ret += sent;
+    }
+    size_t blockBytes = std::min({(size_t)maxTransferSizeBytes_, maxMessageBytes_ - transfers_->bytes, len - offset});
+    blocks.push_back(
+    {
+      .tx_buf = tx ? (uint64_t)(uintptr_t)(tx + offset) : 0,
+      .rx_buf = rx ? (uint64_t)(uintptr_t)(rx + offset) : 0,
+      .len = (uint32_t)blockBytes,
       .speed_hz = maxBusSpeedHz_,
       .delay_usecs = delayUs,
       .bits_per_word = bitsPerWord_,
-	  };
+      .cs_change = csChange,
+    });
+    offset += blockBytes;
+    transfers_->bytes += blockBytes;
   }
-	ret = ioctl(spiFile_, SPI_IOC_MESSAGE(blocks), transfers.data());
   #endif
   return ret;
 }
+
+int SPIDevice::flush()
+{
+  int ret = 0;
+  #ifndef SIMULATE_PI_HARDWARE
+  std::vector<spi_ioc_transfer>& blocks = transfers_->blocks;
+  if (!blocks.empty())
+  {
+    ret = ioctl(spiFile_, SPI_IOC_MESSAGE(blocks.size()), blocks.data());
+    blocks.clear();
+    transfers_->bytes = 0;
+  }
+  #endif
+  return ret < 0 ? -1 : ret;
+}
@@ -4,6 +4,8 @@
 #include "ImageIO.hpp"
 #include "Draw.hpp"
 #include "QRCode.hpp"
+#include "Compositor.hpp"
+#include "DisplayScheduler.hpp"
 
 #include <gpio-cpp/gpio.hpp>
 #include <magic_enum.hpp>
@@ -24,6 +26,19 @@ static void InterruptHandler(int signo)
     interrupt_received = true;
 }
 
+static void PrintShowTimings(const Inky& display)
+{
+  for (const auto& timing : display.lastShowTimings())
+  {
+    std::cout << "\t" << timing.phase << ": " << timing.milliseconds << " ms";
+    if (timing.busyWaitMilliseconds > 0)
+    {
+      std::cout << " (busy " << timing.busyWaitMilliseconds << " ms, wake latency " << timing.busyWakeLatencyMilliseconds << " ms)";
+    }
+    std::cout << std::endl;
+  }
+}
+
 int main(int argc, char *argv[])
 {
   // Subscribe to signal interrupts
@@ -39,13 +54,43 @@ int main(int argc, char *argv[])
   std::cout << "\tDisplay Variant: " << display->info().displayVariant << std::endl;
   std::cout << "\tWrite Time: " << display->info().writeTime << std::endl;
 
+  // The SPI clock is saved per unit, so these only need running once
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--calibrate-spi")
+    {
+      std::cout << "Calibrating the SPI clock..." << std::endl;
+      try
+      {
+        display->calibrateSpiClock();
+      }
+      catch (const std::exception& e)
+      {
+        // e.g. a panel that can't read back its RAM, the current clock still works
+        std::cerr << "SPI clock calibration failed: " << e.what() << std::endl;
+        std::cerr << "Set a known good clock with --spi-clock <hz> instead." << std::endl;
+      }
+    }
+    else if (arg == "--spi-clock" && i + 1 < argc)
+    {
+      display->setSpiClock((uint32_t)std::stoul(argv[++i]));
+    }
+  }
+  std::cout << "\tSPI Clock: " << display->spiClock() << " Hz" << std::endl;
+
+  // All refreshes go through the scheduler, so the handlers below never block on one and
+  // requests made during a refresh collapse in to the newest. The main loop reports each
+  // refresh once it finishes.
+  DisplayScheduler scheduler(*display, {.minRefreshInterval = std::chrono::seconds(5)});
+
   // Http Service Setup
   HttpService http;
   http.Server().Get("/current_photo.png",
   [&](const Request &req, Response &res) 
   {
     std::string imgBuf;
-    ImageIO::SaveToBuffer(display->getImage(), imgBuf, {.saveFormat = ImageFormat::PNG});
+    ImageIO::SaveToBuffer(display->getImage(), imgBuf, {.saveFormat = ImageFormat::PNG, .encodeProfile = EncodeProfile::Fastest});
     res.set_content(imgBuf, "image/png");
   });
 
@@ -68,8 +113,7 @@ int main(int argc, char *argv[])
                 std::cout << "Image appears to be an image, sending to display..." << std::endl;
                 Image newImage = ImageIO::LoadFromBuffer(data.content);
                 newImage.scale(display->info().width, display->info().height, {.scaleMode = ScaleMode::Fill});
-                display->setImage(newImage);
-                display->show();
+                scheduler.submit(newImage);
                 break;
             }
         }
@@ -111,8 +155,7 @@ int main(int argc, char *argv[])
       qrCode.crop(0, 0, display->info().width, display->info().height);
       Draw::Text(qrCode, display->info().width / 2, display->info().height-50, configURL, {.hAlign = Draw::HAlign::Center});
       Draw::Text(qrCode, display->info().width / 2, display->info().height-30, "Scan the QR code to upload a new photo.", {.hAlign = Draw::HAlign::Center});
-      display->setImage(qrCode, {.scaleMode = ScaleMode::Fill}, {.ditherAccuracy = 0});
-      display->show();
+      scheduler.submit(qrCode, RefreshPriority::Interactive, {.scaleMode = ScaleMode::Fill}, {.ditherAccuracy = 0});
     }
   });
 
@@ -120,15 +163,27 @@ int main(int argc, char *argv[])
   {
     if (transition == Gpio::LineTransition::FallingEdge)
     {
-      display->show(Inky::ShowOperation::ColorTest);
+      scheduler.submit(Inky::ShowOperation::ColorTest);
     }
   });
 
+  // The demo frame is a dithered layer of random boxes under pixel exact text.
+  // The text layer never changes, so it is only converted to the palette once.
+  Compositor demoFrame(display->info().width, display->info().height, display->getColorMap());
+  int boxLayer = demoFrame.addLayer(LayerPolicy::Diffusion, 0.8f);
+  int textLayer = demoFrame.addLayer(LayerPolicy::ExactSnap);
+  {
+    Image& text = demoFrame.layer(textLayer);
+    Draw::Text(text, text.width()/2, text.height()/2 - 41, "Inky Frame", {.hAlign = Draw::HAlign::Center, .font = Draw::Font::Mono_32x48});
+    Draw::Text(text, text.width()/2, text.height()/2 + 12, "Powered by inky-cpp", {.hAlign = Draw::HAlign::Center, .font = Draw::Font::Mono_8x12});
+    Draw::Text(text, text.width()/2, text.height()/2 + 28, "https://github.com/DonkeyKong/inky-cpp", {.hAlign = Draw::HAlign::Center, .font = Draw::Font::Mono_8x12});
+  }
+
   gpio.subscribe(16, [&](int line, Gpio::LineTransition transition, std::chrono::steady_clock::time_point timestamp)
   {
     if (transition == Gpio::LineTransition::FallingEdge)
     {
-      Image img(display->info().width, display->info().height);
+      Image& img = demoFrame.layer(boxLayer);
 
       std::random_device dev;
       std::mt19937 rng(dev());
@@ -150,17 +205,8 @@ int main(int argc, char *argv[])
 
       Draw::Box(img, img.width()/2, img.height()/2, 340, 88, {.hAlign = Draw::HAlign::Center, .vAlign = Draw::VAlign::Center, .color = {128,255,128}});
 
-      // Convert to indexed here so we can dither the boxes and not the text
-      img.toIndexed(display->getColorMap(), {.ditherAccuracy = 0.8f});
-
-      Draw::Text(img, img.width()/2, img.height()/2 - 41, "Inky Frame", {.hAlign = Draw::HAlign::Center, .font = Draw::Font::Mono_32x48});
-      Draw::Text(img, img.width()/2, img.height()/2 + 12, "Powered by inky-cpp", {.hAlign = Draw::HAlign::Center, .font = Draw::Font::Mono_8x12});
-      Draw::Text(img, img.width()/2, img.height()/2 + 28, "https://github.com/DonkeyKong/inky-cpp", {.hAlign = Draw::HAlign::Center, .font = Draw::Font::Mono_8x12});
-      
-      // Make sure the dither accuracy is set to 0 to ensure sharp pixel exact text
-      display->setImage(img, {.scaleMode = ScaleMode::Fill}, {.ditherAccuracy = 0}); 
-      
-      display->show();
+      // The composited frame is already in the display palette, so keep it pixel exact
+      scheduler.submit(demoFrame.compose(), RefreshPriority::Background, {.scaleMode = ScaleMode::Fill}, {.ditherAccuracy = 0});
     }
   });
 
@@ -168,15 +214,33 @@ int main(int argc, char *argv[])
   {
     if (transition == Gpio::LineTransition::FallingEdge)
     {
-      display->show(Inky::ShowOperation::CleanDisplay);
+      // Cleaning is meant to be repeated to clear ghosting, so never skip it
+      scheduler.submit(Inky::ShowOperation::CleanDisplay, RefreshPriority::Normal, true);
     }
   });
 
   // Start the main waiting loop
+  DisplayScheduler::Stats lastStats;
   while (!interrupt_received && !internal_exit)
   {
       // Regulate update rate
       std::this_thread::sleep_for(std::chrono::seconds(1));
+
+      auto stats = scheduler.stats();
+      if (stats.completed != lastStats.completed)
+      {
+        std::cout << "Display refreshed" << std::endl;
+        PrintShowTimings(*display);
+      }
+      if (stats.failed != lastStats.failed)
+      {
+        std::cerr << "Display refresh failed: " << stats.lastError << std::endl;
+      }
+      if (stats.dropped != lastStats.dropped)
+      {
+        std::cout << "Dropped " << stats.dropped << " of " << stats.submitted << " refresh requests so far" << std::endl;
+      }
+      lastStats = stats;
   }
 
   if (interrupt_received)
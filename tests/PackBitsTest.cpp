@@ -0,0 +1,126 @@
+#include "PackBits.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <vector>
+
+// Packs rows with every kernel this build has and checks each against the scalar kernel,
+// which is checked against a few rows worked out by hand first.
+
+static const PackBitsKernel Kernels[] = {PackBitsKernel::Swar, PackBitsKernel::Sse2, PackBitsKernel::Neon};
+static const char* KernelNames[] = {"Swar", "Sse2", "Neon"};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what, const char* kernel, int width, int offset)
+{
+  if (!ok)
+  {
+    std::printf("FAIL %s: %s, width %d, row offset %d\n", kernel, what, width, offset);
+    ++failures;
+  }
+}
+
+// Output buffers start as garbage so the tests catch bytes that aren't written or padding that isn't cleared
+static std::vector<uint8_t> garbage(int width)
+{
+  return std::vector<uint8_t>((width + 7) / 8, 0xA5);
+}
+
+static void checkReference()
+{
+  struct Case
+  {
+    std::vector<IndexedColor> row;
+    std::vector<uint8_t> a;
+    std::vector<uint8_t> b;
+  };
+  const Case cases[] =
+  {
+    {{1}, {0x80}, {0x00}},
+    {{2}, {0x00}, {0x80}},
+    {{1, 2, 1}, {0xA0}, {0x40}},
+    {{1, 1, 1, 1, 1, 1, 1, 1}, {0xFF}, {0x00}},
+    {{0, 1, 2, 3, 1, 2, 3, 1, 2}, {0x49, 0x00}, {0x24, 0x80}},
+  };
+  for (const auto& c : cases)
+  {
+    int width = (int)c.row.size();
+    auto a = garbage(width);
+    auto b = garbage(width);
+    packRowBits(PackBitsKernel::Scalar, c.row.data(), width, 1, a.data(), 2, b.data());
+    expect(a == c.a && b == c.b, "hand worked row", "Scalar", width, 0);
+  }
+}
+
+static void checkKernel(PackBitsKernel kernel, const char* name, std::mt19937& rng)
+{
+  std::vector<int> widths;
+  for (int width = 1; width <= 17; ++width)
+  {
+    widths.push_back(width);
+  }
+  for (int width : {31, 32, 33, 63, 64, 65, 399, 400, 600, 640, 641})
+  {
+    widths.push_back(width);
+  }
+
+  // Mostly the two packed colors, so runs of set and clear bits both turn up
+  std::uniform_int_distribution<int> color(0, 3);
+  for (int width : widths)
+  {
+    // Rows that don't start on a vector boundary, like rows of an odd width frame
+    for (int offset = 0; offset < 3; ++offset)
+    {
+      for (int trial = 0; trial < 20; ++trial)
+      {
+        std::vector<IndexedColor> pixels(width + offset);
+        for (auto& pixel : pixels)
+        {
+          pixel = (IndexedColor)color(rng);
+        }
+        const IndexedColor* row = pixels.data() + offset;
+
+        auto expectA = garbage(width);
+        auto expectB = garbage(width);
+        packRowBits(PackBitsKernel::Scalar, row, width, 1, expectA.data(), 2, expectB.data());
+
+        auto a = garbage(width);
+        auto b = garbage(width);
+        packRowBits(kernel, row, width, 1, a.data(), 2, b.data());
+        expect(a == expectA, "first plane differs", name, width, offset);
+        expect(b == expectB, "second plane differs", name, width, offset);
+
+        auto single = garbage(width);
+        packRowBits(kernel, row, width, 1, single.data(), 2, nullptr);
+        expect(single == expectA, "single plane differs", name, width, offset);
+      }
+    }
+  }
+}
+
+int main()
+{
+  checkReference();
+
+  std::mt19937 rng(38);
+  for (size_t i = 0; i < std::size(Kernels); ++i)
+  {
+    if (!packBitsKernelAvailable(Kernels[i]))
+    {
+      std::printf("skip %s: not in this build\n", KernelNames[i]);
+      continue;
+    }
+    checkKernel(Kernels[i], KernelNames[i], rng);
+    std::printf("checked %s\n", KernelNames[i]);
+  }
+
+  if (failures > 0)
+  {
+    std::printf("%d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Converts 16x16 character grid font images into packed 1-bit glyph bitmaps
+that are compiled into inky-cpp, so no font files are read at runtime.
+
+Usage: generate_fonts.py <output header> <font png>...
+Fonts are named after their file, e.g. font_8x12.png becomes Mono_8x12.
+Only the python standard library is used so this runs anywhere cmake does.
+"""
+
+import os
+import struct
+import sys
+import zlib
+
+def read_png(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:8] != b'\x89PNG\r\n\x1a\n':
+        raise ValueError(f'{path} is not a png')
+
+    pos = 8
+    idat = b''
+    while pos < len(data):
+        length, chunk_type = struct.unpack('>I4s', data[pos:pos + 8])
+        chunk = data[pos + 8:pos + 8 + length]
+        if chunk_type == b'IHDR':
+            width, height, bit_depth, color_type, _, _, interlace = struct.unpack('>IIBBBBB', chunk)
+        elif chunk_type == b'IDAT':
+            idat += chunk
+        pos += 12 + length
+
+    channels = {0: 1, 2: 3, 4: 2, 6: 4}.get(color_type)
+    if bit_depth != 8 or channels is None or interlace != 0:
+        raise ValueError(f'{path}: only 8 bit, non-interlaced gray/rgb(a) pngs are supported')
+
+    raw = zlib.decompress(idat)
+    stride = width * channels
+    rows = []
+    prev = bytearray(stride)
+    for y in range(height):
+        filter_type = raw[y * (stride + 1)]
+        row = bytearray(raw[y * (stride + 1) + 1:(y + 1) * (stride + 1)])
+        for i in range(stride):
+            left = row[i - channels] if i >= channels else 0
+            up = prev[i]
+            up_left = prev[i - channels] if i >= channels else 0
+            if filter_type == 1:
+                row[i] = (row[i] + left) & 0xFF
+            elif filter_type == 2:
+                row[i] = (row[i] + up) & 0xFF
+            elif filter_type == 3:
+                row[i] = (row[i] + ((left + up) >> 1)) & 0xFF
+            elif filter_type == 4:
+                p = left + up - up_left
+                pa, pb, pc = abs(p - left), abs(p - up), abs(p - up_left)
+                predictor = left if (pa <= pb and pa <= pc) else (up if pb <= pc else up_left)
+                row[i] = (row[i] + predictor) & 0xFF
+        rows.append(row)
+        prev = row
+
+    # Reduce to a lit/unlit grid, lit meaning closer to white than black
+    lit = []
+    for row in rows:
+        lit.append([sum(row[x * channels:x * channels + min(channels, 3)]) > 127 * min(channels, 3) for x in range(width)])
+    return width, height, lit
+
+def font_name(path):
+    base = os.path.splitext(os.path.basename(path))[0]
+    return 'Mono_' + base.split('_', 1)[1]
+
+def main():
+    if len(sys.argv) < 3:
+        print(__doc__)
+        sys.exit(1)
+
+    out_path = sys.argv[1]
+    lines = [
+        '// Generated by tools/generate_fonts.py. Do not edit.',
+        '#pragma once',
+        '',
+        '#include <stdint.h>',
+        '',
+        'namespace FontData',
+        '{',
+    ]
+
+    for path in sys.argv[2:]:
+        width, height, lit = read_png(path)
+        char_width, char_height = width // 16, height // 16
+        if char_width > 32:
+            raise ValueError(f'{path}: glyphs wider than 32 pixels are not supported')
+
+        # Each glyph is char_height rows, bit 0 of a row is its leftmost pixel
+        words = []
+        for ch in range(256):
+            origin_x = (ch % 16) * char_width
+            origin_y = (ch // 16) * char_height
+            for y in range(char_height):
+                bits = 0
+                for x in range(char_width):
+                    if lit[origin_y + y][origin_x + x]:
+                        bits |= 1 << x
+                words.append(bits)
+
+        name = font_name(path)
+        lines.append(f'  inline constexpr int {name}_CharWidth = {char_width};')
+        lines.append(f'  inline constexpr int {name}_CharHeight = {char_height};')
+        lines.append(f'  inline constexpr uint32_t {name}_Rows[{len(words)}] =')
+        lines.append('  {')
+        for i in range(0, len(words), char_height):
+            lines.append('    ' + ', '.join(f'0x{w:x}' for w in words[i:i + char_height]) + ',')
+        lines.append('  };')
+        lines.append('')
+
+    lines.append('}')
+
+    os.makedirs(os.path.dirname(os.path.abspath(out_path)), exist_ok=True)
+    with open(out_path, 'w') as f:
+        f.write('\n'.join(lines) + '\n')
+
+if __name__ == '__main__':
+    main()